@@ -41,6 +41,25 @@ input_getc (void)
   return key;
 }
 
+/** Retrieves a key from the input buffer into *KEY and returns
+   true, waiting for a key to be pressed like input_getc(), unless
+   the current thread is interrupted first, in which case it
+   returns false. */
+bool
+input_getc_interruptible (uint8_t *key) 
+{
+  enum intr_level old_level;
+  bool success;
+
+  old_level = intr_disable ();
+  success = intq_getc_interruptible (&buffer, key);
+  if (success)
+    serial_notify ();
+  intr_set_level (old_level);
+
+  return success;
+}
+
 /** Returns true if the input buffer is full,
    false otherwise.
    Interrupts must be off. */
@@ -54,6 +54,31 @@ intq_getc (struct intq *q)
   return byte;
 }
 
+/** Removes a byte from Q into *BYTE and returns true, sleeping
+   until a byte is added if Q is empty, like intq_getc().  If the
+   current thread is interrupted first (see thread_interrupt()),
+   returns false without removing anything instead.  Must not be
+   called from an interrupt handler. */
+bool
+intq_getc_interruptible (struct intq *q, uint8_t *byte) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!intr_context ());
+  while (intq_empty (q)) 
+    {
+      if (!lock_acquire_interruptible (&q->lock))
+        return false;
+      if (intq_empty (q) && !thread_interrupted ())
+        thread_block_interruptible (&q->not_empty);
+      lock_release (&q->lock);
+      if (thread_interrupted ())
+        return false;
+    }
+
+  *byte = intq_getc (q);
+  return true;
+}
+
 /** Adds BYTE to the end of Q.
    If Q is full, sleeps until a byte is removed.
    When called from an interrupt handler, Q must not be full. */
@@ -38,6 +38,7 @@ void intq_init (struct intq *);
 bool intq_empty (const struct intq *);
 bool intq_full (const struct intq *);
 uint8_t intq_getc (struct intq *);
+bool intq_getc_interruptible (struct intq *, uint8_t *);
 void intq_putc (struct intq *, uint8_t);
 
 #endif /**< devices/intq.h */
@@ -1,16 +1,34 @@
 /** cat.c
 
-   Prints files specified on command line to the console. */
+   Prints files specified on command line to the console, or its
+   standard input if there are none, so that it can be used at the
+   end of a pipeline. */
 
 #include <stdio.h>
 #include <syscall.h>
 
+/** Copies FD to standard output until end of file. */
+static void
+copy (int fd) 
+{
+  for (;;) 
+    {
+      char buffer[1024];
+      int bytes_read = read (fd, buffer, sizeof buffer);
+      if (bytes_read <= 0)
+        break;
+      write (STDOUT_FILENO, buffer, bytes_read);
+    }
+}
+
 int
 main (int argc, char *argv[]) 
 {
   bool success = true;
   int i;
   
+  if (argc < 2)
+    copy (STDIN_FILENO);
   for (i = 1; i < argc; i++) 
     {
       int fd = open (argv[i]);
@@ -20,14 +38,7 @@ main (int argc, char *argv[])
           success = false;
           continue;
         }
-      for (;;) 
-        {
-          char buffer[1024];
-          int bytes_read = read (fd, buffer, sizeof buffer);
-          if (bytes_read == 0)
-            break;
-          write (STDOUT_FILENO, buffer, bytes_read);
-        }
+      copy (fd);
       close (fd);
     }
   return success ? EXIT_SUCCESS : EXIT_FAILURE;
@@ -4,6 +4,9 @@
 #include <syscall.h>
 
 static void read_line (char line[], size_t);
+static void run_command (char *command);
+static bool parse_redirections (char *command, struct spawn_action[],
+                                int *action_cnt);
 static bool backspace (char **pos, char line[]);
 
 int
@@ -31,17 +34,136 @@ main (void)
           /* Empty command. */
         }
       else
+        run_command (command);
+    }
+
+  printf ("Shell exiting.");
+  return EXIT_SUCCESS;
+}
+
+/** Maximum number of programs in a pipeline. */
+#define MAX_STAGES 8
+
+/** Runs COMMAND and waits for it to finish.  COMMAND may be a
+   pipeline of programs separated by "|", each of which reads the
+   output of the one before through a pipe.  Each program may be
+   followed by "< FILE" and "> FILE" to open its input or output to
+   an existing FILE instead.  spawn() sets up all of this before
+   each program starts. */
+static void
+run_command (char *command)
+{
+  char *stages[MAX_STAGES];
+  pid_t pids[MAX_STAGES];
+  int stage_cnt = 0;
+  int started = 0;
+  int prev_read = -1;
+  char *stage, *save_ptr;
+  int i;
+
+  for (stage = strtok_r (command, "|", &save_ptr); stage != NULL;
+       stage = strtok_r (NULL, "|", &save_ptr))
+    {
+      if (stage_cnt >= MAX_STAGES)
         {
-          pid_t pid = exec (command);
-          if (pid != PID_ERROR)
-            printf ("\"%s\": exit code %d\n", command, wait (pid));
+          printf ("pipeline too long\n");
+          return;
+        }
+      stages[stage_cnt++] = stage + strspn (stage, " ");
+    }
+
+  for (i = 0; i < stage_cnt; i++)
+    {
+      /* Room for the pipes on either side plus two redirections. */
+      struct spawn_action actions[4];
+      int action_cnt = 0;
+      int fds[2] = {-1, -1};
+
+      /* Connect to the pipes first, so that redirections to files
+         take precedence. */
+      if (prev_read >= 0)
+        {
+          actions[action_cnt].type = SPAWN_DUP;
+          actions[action_cnt].fd = STDIN_FILENO;
+          actions[action_cnt++].src_fd = prev_read;
+        }
+      if (i + 1 < stage_cnt)
+        {
+          if (!pipe (fds))
+            {
+              printf ("pipe failed\n");
+              break;
+            }
+          actions[action_cnt].type = SPAWN_DUP;
+          actions[action_cnt].fd = STDOUT_FILENO;
+          actions[action_cnt++].src_fd = fds[1];
+        }
+
+      if (parse_redirections (stages[i], actions, &action_cnt))
+        {
+          pids[started] = spawn (stages[i], actions, action_cnt);
+          if (pids[started] != PID_ERROR)
+            started++;
           else
             printf ("exec failed\n");
         }
+      else
+        printf ("syntax error\n");
+
+      /* The children hold their own descriptors for the pipes. */
+      if (prev_read >= 0)
+        close (prev_read);
+      if (fds[1] >= 0)
+        close (fds[1]);
+      prev_read = fds[0];
     }
+  if (prev_read >= 0)
+    close (prev_read);
 
-  printf ("Shell exiting.");
-  return EXIT_SUCCESS;
+  for (i = 0; i < started; i++)
+    printf ("\"%s\": exit code %d\n", stages[i], wait (pids[i]));
+}
+
+/** Removes any "< FILE" and "> FILE" redirections from the end of
+   COMMAND, which is modified, and appends an action for each to
+   the *ACTION_CNT in ACTIONS, which must have room for two more.
+   Returns false if the redirections are malformed. */
+static bool
+parse_redirections (char *command, struct spawn_action actions[],
+                    int *action_cnt)
+{
+  char *p = command + strcspn (command, "<>");
+  int redir_cnt = 0;
+
+  while (*p != '\0')
+    {
+      struct spawn_action *a;
+
+      if ((*p != '<' && *p != '>') || redir_cnt++ >= 2)
+        return false;
+      a = &actions[(*action_cnt)++];
+      a->type = SPAWN_OPEN;
+      a->fd = *p == '<' ? STDIN_FILENO : STDOUT_FILENO;
+
+      /* Null-terminate the command or the previous file name, then
+         find the file name. */
+      *p++ = '\0';
+      p += strspn (p, " ");
+      a->path = p;
+      p += strcspn (p, " <>");
+      if (p == a->path)
+        return false;
+      if (*p == ' ')
+        {
+          *p++ = '\0';
+          p += strspn (p, " ");
+        }
+    }
+
+  /* Drop trailing spaces, for the exit code message. */
+  for (p = command + strlen (command); p > command && p[-1] == ' '; p--)
+    p[-1] = '\0';
+  return true;
 }
 
 /** Reads a line of input from the user into LINE, which has room
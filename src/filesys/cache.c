@@ -0,0 +1,477 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/** Buffer cache.
+
+   Holds up to CACHE_SIZE sectors of the file system device, so
+   that repeated accesses to a sector go to memory instead of the
+   disk, and a write to part of a sector needs no bounce buffer
+   and, if the sector is cached, no read.  Writes are held back: a
+   modified sector goes to disk when its slot is reused, when
+   cache_flush() is called, as filesys_done() does at shutdown, or
+   when the flusher thread writes it back.  The flusher runs every
+   FLUSH_INTERVAL ticks and whenever the CPU goes idle with dirty
+   sectors in the cache.  It writes in order of ascending sector
+   number, to keep disk seeks short.  A writer that would make
+   more than DIRTY_MAX sectors dirty writes them back itself
+   first, so that writers cannot get far ahead of the disk.
+
+   Cached sectors are found through a hash table keyed by sector
+   number.  When a slot is needed and none is free, the clock
+   algorithm picks one: the hand sweeps over the slots, clearing
+   each one's accessed bit, and stops at the first that has not
+   been accessed since the hand last passed it.
+
+   Locking is split in two, so that no disk I/O happens while
+   cache_lock is held and a thread that finds its sector cached
+   need not wait for another thread's disk access.  cache_lock
+   protects the index, the clock hand, and each slot's bookkeeping;
+   each slot's own lock protects its data and is held across the
+   slot's disk I/O.  A thread that uses a slot first pins it, so
+   that it is not reused for another sector meanwhile, and then
+   acquires its lock.  A slot is picked for reuse only if it is
+   not pinned, so its lock is free; a dirty one is written back
+   first, with cache_lock released, and the search starts over.
+
+   Each disk transfer is charged to a process's resource usage:
+   a read to the thread that missed, a write-back to whoever last
+   modified the slot, whichever thread does the write.  See
+   lib/rusage.h.
+
+   Sectors that a reader is expected to want soon can be queued
+   with cache_readahead().  A kernel thread brings them into the
+   cache in the background, so that the reader finds them there
+   instead of waiting for the disk. */
+
+/** A cache slot. */
+struct cache_entry
+  {
+    struct hash_elem elem;      /**< Element in `cache_index'. */
+    block_sector_t sector;      /**< Sector held, if `in_use'. */
+    bool in_use;                /**< Does the slot hold a sector? */
+    bool dirty;                 /**< Modified since read from disk? */
+    bool accessed;              /**< Used since the hand passed? */
+    int pin_cnt;                /**< Number of threads using the slot. */
+    struct rusage *owner;       /**< Charged for writing it back. */
+    struct lock lock;           /**< Protects `data'. */
+    uint8_t *data;              /**< BLOCK_SECTOR_SIZE bytes. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+static uint8_t cache_data[CACHE_SIZE][BLOCK_SECTOR_SIZE];
+static struct hash cache_index; /**< In-use slots, by sector. */
+static size_t clock_hand;       /**< Next slot to consider reusing. */
+static size_t dirty_cnt;        /**< Number of dirty slots. */
+static struct lock cache_lock;  /**< Protects all of the above. */
+static struct condition unpinned; /**< Signaled when a pin is dropped. */
+
+/** Flusher thread. */
+#define FLUSH_INTERVAL TIMER_FREQ       /**< Ticks between flushes. */
+#define DIRTY_MAX (CACHE_SIZE / 2)      /**< Most dirty slots. */
+static struct semaphore flush_sema;     /**< Upped to start a flush. */
+static bool flush_pending;      /**< Has flush_sema been upped? */
+static unsigned flush_ticks;    /**< Ticks since the last wakeup. */
+static bool cache_ready;        /**< Has cache_init() finished? */
+
+static hash_hash_func cache_hash;
+static hash_less_func cache_less;
+
+/** Read-ahead queue, a ring buffer of sectors for the read-ahead
+   thread to bring into the cache. */
+#define READAHEAD_QUEUE 32
+static block_sector_t ra_queue[READAHEAD_QUEUE];
+static size_t ra_head;          /**< Index of the oldest sector. */
+static size_t ra_cnt;           /**< Number of queued sectors. */
+static struct lock ra_lock;     /**< Protects the queue. */
+static struct condition ra_cond; /**< Signaled when ra_cnt > 0. */
+
+static thread_func readahead_thread NO_RETURN;
+static thread_func flusher_thread NO_RETURN;
+static struct cache_entry *get_entry (block_sector_t, bool read);
+static void put_entry (struct cache_entry *, bool dirty);
+static void write_behind (void);
+
+/** Returns the resource usage to charge for disk transfers that
+   the running thread causes, or a null pointer if none. */
+static struct rusage *
+current_rusage (void) 
+{
+#ifdef USERPROG
+  return thread_current ()->rusage;
+#else
+  return NULL;
+#endif
+}
+
+/** Initializes the buffer cache. */
+void
+cache_init (void) 
+{
+  size_t i;
+
+  if (!hash_init (&cache_index, cache_hash, cache_less, NULL))
+    PANIC ("cache_init: out of memory");
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      cache[i].data = cache_data[i];
+      lock_init (&cache[i].lock);
+    }
+  lock_init (&cache_lock);
+  cond_init (&unpinned);
+
+  lock_init (&ra_lock);
+  cond_init (&ra_cond);
+  thread_create ("readahead", PRI_DEFAULT, readahead_thread, NULL);
+
+  sema_init (&flush_sema, 0);
+  thread_create ("flusher", PRI_DEFAULT, flusher_thread, NULL);
+  cache_ready = true;
+}
+
+static unsigned
+cache_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct cache_entry *c = hash_entry (e, struct cache_entry, elem);
+  return hash_int (c->sector);
+}
+
+static bool
+cache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct cache_entry *a = hash_entry (a_, struct cache_entry, elem);
+  const struct cache_entry *b = hash_entry (b_, struct cache_entry, elem);
+  return a->sector < b->sector;
+}
+
+/** Returns the slot holding SECTOR, or a null pointer if it is not
+   cached.  Must be called with cache_lock held. */
+static struct cache_entry *
+lookup (block_sector_t sector)
+{
+  struct cache_entry key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&cache_index, &key.elem);
+  return e != NULL ? hash_entry (e, struct cache_entry, elem) : NULL;
+}
+
+/** Picks a slot that is not pinned with the clock algorithm and
+   returns it, or a null pointer if every slot is pinned.  Must be
+   called with cache_lock held. */
+static struct cache_entry *
+pick_victim (void)
+{
+  size_t i;
+
+  /* Two sweeps: the first may only clear accessed bits. */
+  for (i = 0; i < 2 * CACHE_SIZE; i++)
+    {
+      struct cache_entry *c = &cache[clock_hand];
+
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+      if (!c->in_use)
+        return c;
+      else if (c->pin_cnt > 0)
+        continue;
+      else if (c->accessed)
+        c->accessed = false;
+      else
+        return c;
+    }
+  return NULL;
+}
+
+/** Writes C, which must be dirty, back to disk, charging the write
+   to C's owner.  Must be called with cache_lock held, which is
+   released during the write and then reacquired. */
+static void
+write_entry (struct cache_entry *c)
+{
+  ASSERT (c->dirty);
+
+  /* The owner may go away once cache_lock is released, so charge
+     it now. */
+  if (c->owner != NULL)
+    c->owner->sectors_written++;
+  c->owner = NULL;
+  c->pin_cnt++;
+  c->dirty = false;
+  dirty_cnt--;
+  lock_release (&cache_lock);
+
+  lock_acquire (&c->lock);
+  block_write (fs_device, c->sector, c->data);
+  lock_release (&c->lock);
+
+  lock_acquire (&cache_lock);
+  if (--c->pin_cnt == 0)
+    cond_broadcast (&unpinned, &cache_lock);
+}
+
+/** Compares the sectors that A_ and B_ point to, for qsort(). */
+static int
+compare_sector (const void *a_, const void *b_) 
+{
+  const block_sector_t *a = a_;
+  const block_sector_t *b = b_;
+  return *a < *b ? -1 : *a > *b;
+}
+
+/** Writes every dirty slot back to disk, in order of ascending
+   sector number.  Sectors dirtied meanwhile may or may not be
+   written. */
+static void
+write_behind (void) 
+{
+  block_sector_t batch[CACHE_SIZE];
+  size_t cnt = 0;
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].in_use && cache[i].dirty)
+      batch[cnt++] = cache[i].sector;
+  qsort (batch, cnt, sizeof *batch, compare_sector);
+
+  /* A slot may have been written back, or reused, while the lock
+     was released for an earlier write, so look each one up
+     again. */
+  for (i = 0; i < cnt; i++)
+    {
+      struct cache_entry *c = lookup (batch[i]);
+      if (c != NULL && c->dirty)
+        write_entry (c);
+    }
+  lock_release (&cache_lock);
+}
+
+/** Returns the slot holding SECTOR, pinned and locked, putting the
+   sector into a slot first if it is not cached.  If READ is false,
+   the caller is about to overwrite all of the sector, so its
+   contents are not read from disk.  A read is charged to the
+   running thread's process.  The caller must release the slot
+   with put_entry(). */
+static struct cache_entry *
+get_entry (block_sector_t sector, bool read)
+{
+  struct cache_entry *c;
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      c = lookup (sector);
+      if (c != NULL)
+        {
+          /* Cached, or being read in by another thread, in which
+             case acquiring the lock waits for the read. */
+          c->pin_cnt++;
+          c->accessed = true;
+          lock_release (&cache_lock);
+          lock_acquire (&c->lock);
+          return c;
+        }
+
+      c = pick_victim ();
+      if (c == NULL)
+        cond_wait (&unpinned, &cache_lock);
+      else if (c->in_use && c->dirty)
+        write_entry (c);
+      else
+        break;
+    }
+
+  /* Move the slot over to SECTOR.  The slot is not pinned, so its
+     lock is free. */
+  if (c->in_use)
+    hash_delete (&cache_index, &c->elem);
+  c->sector = sector;
+  c->in_use = true;
+  c->dirty = false;
+  c->accessed = true;
+  c->pin_cnt = 1;
+  c->owner = NULL;
+  hash_insert (&cache_index, &c->elem);
+  lock_acquire (&c->lock);
+  lock_release (&cache_lock);
+
+  if (read)
+    {
+      struct rusage *usage = current_rusage ();
+
+      block_read (fs_device, sector, c->data);
+      if (usage != NULL)
+        usage->sectors_read++;
+    }
+  return c;
+}
+
+/** Unlocks and unpins C, which was obtained from get_entry(), and
+   marks it dirty if DIRTY is true, to be written back at the
+   running thread's process's expense. */
+static void
+put_entry (struct cache_entry *c, bool dirty) 
+{
+  lock_release (&c->lock);
+
+  lock_acquire (&cache_lock);
+  if (dirty)
+    {
+      if (!c->dirty)
+        {
+          c->dirty = true;
+          dirty_cnt++;
+        }
+      c->owner = current_rusage ();
+    }
+  if (--c->pin_cnt == 0)
+    cond_broadcast (&unpinned, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/** Copies SIZE bytes starting at byte offset OFS within SECTOR of
+   the file system device into BUFFER. */
+void
+cache_read (block_sector_t sector, void *buffer, size_t ofs, size_t size)
+{
+  struct cache_entry *c;
+
+  ASSERT (ofs <= BLOCK_SECTOR_SIZE && size <= BLOCK_SECTOR_SIZE - ofs);
+
+  c = get_entry (sector, true);
+  memcpy (buffer, c->data + ofs, size);
+  put_entry (c, false);
+}
+
+/** Copies SIZE bytes from BUFFER into SECTOR of the file system
+   device, starting at byte offset OFS within the sector.  The
+   write reaches the disk later; see cache_flush(). */
+void
+cache_write (block_sector_t sector, const void *buffer,
+             size_t ofs, size_t size)
+{
+  struct cache_entry *c;
+
+  ASSERT (ofs <= BLOCK_SECTOR_SIZE && size <= BLOCK_SECTOR_SIZE - ofs);
+
+  if (dirty_cnt >= DIRTY_MAX)
+    write_behind ();
+  c = get_entry (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (c->data + ofs, buffer, size);
+  put_entry (c, true);
+}
+
+/** Writes every modified sector in the cache to disk. */
+void
+cache_flush (void) 
+{
+  write_behind ();
+}
+
+/** Stops charging USAGE for writing back the sectors it last
+   modified, because it is about to be freed. */
+void
+cache_forget_rusage (const struct rusage *usage) 
+{
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].owner == usage)
+      cache[i].owner = NULL;
+  lock_release (&cache_lock);
+}
+
+/** Wakes up the flusher thread, unless it is already awake. */
+static void
+wake_flusher (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  if (!flush_pending)
+    {
+      flush_pending = true;
+      sema_up (&flush_sema);
+    }
+  intr_set_level (old_level);
+}
+
+/** Called by the timer interrupt handler at each timer tick.
+   Wakes up the flusher thread every FLUSH_INTERVAL ticks. */
+void
+cache_tick (void) 
+{
+  if (cache_ready && ++flush_ticks >= FLUSH_INTERVAL)
+    {
+      flush_ticks = 0;
+      wake_flusher ();
+    }
+}
+
+/** Called by the idle thread, with interrupts off, when there is
+   nothing else to run.  Wakes up the flusher thread if any sector
+   is dirty, so that idle time goes to writing it back. */
+void
+cache_idle (void) 
+{
+  if (cache_ready && dirty_cnt > 0)
+    wake_flusher ();
+}
+
+/** Flusher thread.  Writes dirty sectors back each time it is
+   woken up.  Requests to wake it that come in while it is
+   flushing are dropped. */
+static void
+flusher_thread (void *aux UNUSED) 
+{
+  for (;;) 
+    {
+      sema_down (&flush_sema);
+      cache_flush ();
+      flush_pending = false;
+    }
+}
+
+/** Asks for SECTOR to be brought into the cache in the background.
+   This is only a hint: if the queue is full, the request is
+   dropped. */
+void
+cache_readahead (block_sector_t sector) 
+{
+  lock_acquire (&ra_lock);
+  if (ra_cnt < READAHEAD_QUEUE)
+    {
+      ra_queue[(ra_head + ra_cnt++) % READAHEAD_QUEUE] = sector;
+      cond_signal (&ra_cond, &ra_lock);
+    }
+  lock_release (&ra_lock);
+}
+
+/** Read-ahead thread.  Takes sectors off the read-ahead queue, in
+   order, and reads each one that is not already cached. */
+static void
+readahead_thread (void *aux UNUSED) 
+{
+  for (;;) 
+    {
+      block_sector_t sector;
+
+      lock_acquire (&ra_lock);
+      while (ra_cnt == 0)
+        cond_wait (&ra_cond, &ra_lock);
+      sector = ra_queue[ra_head];
+      ra_head = (ra_head + 1) % READAHEAD_QUEUE;
+      ra_cnt--;
+      lock_release (&ra_lock);
+
+      put_entry (get_entry (sector, true), false);
+    }
+}
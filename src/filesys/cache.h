@@ -0,0 +1,20 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <rusage.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/** Number of sectors the buffer cache holds. */
+#define CACHE_SIZE 64
+
+void cache_init (void);
+void cache_read (block_sector_t, void *, size_t ofs, size_t size);
+void cache_write (block_sector_t, const void *, size_t ofs, size_t size);
+void cache_flush (void);
+void cache_readahead (block_sector_t);
+void cache_tick (void);
+void cache_idle (void);
+void cache_forget_rusage (const struct rusage *);
+
+#endif /**< filesys/cache.h */
@@ -0,0 +1,172 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/** Directory entry cache.
+
+   Remembers the results of recent directory lookups, keyed by the
+   sector of the directory's inode and the name looked up, so that
+   looking up the same name again, as resolving the same path
+   again does, need not search the directory.  A lookup that found
+   nothing is remembered too, as a negative entry, so that lookups
+   of missing names are just as cheap.
+
+   directory.c keeps the cache consistent: it invalidates the
+   entry for a name whenever it adds or removes that name.  A
+   directory is removed only once it is empty, so any entries left
+   behind for it are negative ones that remain true of a new
+   directory that reuses its sector.
+
+   At most DCACHE_SIZE entries are kept.  When a new entry is
+   needed and the cache is full, the least recently used entry is
+   discarded. */
+
+/** A cached directory entry. */
+struct dentry
+  {
+    struct hash_elem hash_elem;         /**< Element in `dentries'. */
+    struct list_elem lru_elem;          /**< Element in `lru_list'. */
+    block_sector_t dir;                 /**< Directory's inode sector. */
+    char name[NAME_MAX + 1];            /**< Name looked up. */
+    block_sector_t sector;              /**< Its inode sector, or 0. */
+  };
+
+static struct hash dentries;    /**< All cached entries. */
+static struct list lru_list;    /**< Entries, most recently used first. */
+static struct lock dcache_lock; /**< Protects the cache. */
+
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+
+/** Initializes the directory entry cache. */
+void
+dcache_init (void) 
+{
+  if (!hash_init (&dentries, dentry_hash, dentry_less, NULL))
+    PANIC ("dcache_init: out of memory");
+  list_init (&lru_list);
+  lock_init (&dcache_lock);
+}
+
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+  return a->dir != b->dir ? a->dir < b->dir : strcmp (a->name, b->name) < 0;
+}
+
+/** Returns the cached entry for NAME in the directory whose inode
+   is in sector DIR, or a null pointer if there is none.  Must be
+   called with dcache_lock held. */
+static struct dentry *
+find (block_sector_t dir, const char *name) 
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  key.dir = dir;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/** Looks up NAME in the directory whose inode is in sector DIR in
+   the cache.  If it is cached, returns true and stores into
+   *SECTORP the sector of NAME's inode, or 0 if NAME is known not
+   to exist.  Otherwise, returns false. */
+bool
+dcache_lookup (block_sector_t dir, const char *name,
+               block_sector_t *sectorp) 
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return false;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    {
+      list_remove (&d->lru_elem);
+      list_push_front (&lru_list, &d->lru_elem);
+      *sectorp = d->sector;
+    }
+  lock_release (&dcache_lock);
+
+  return d != NULL;
+}
+
+/** Records that NAME in the directory whose inode is in sector DIR
+   has its inode in SECTOR, or if SECTOR is 0, that it does not
+   exist. */
+void
+dcache_insert (block_sector_t dir, const char *name,
+               block_sector_t sector) 
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    list_remove (&d->lru_elem);
+  else
+    {
+      if (hash_size (&dentries) >= DCACHE_SIZE)
+        {
+          /* Reuse the least recently used entry. */
+          d = list_entry (list_pop_back (&lru_list), struct dentry,
+                          lru_elem);
+          hash_delete (&dentries, &d->hash_elem);
+        }
+      else
+        d = malloc (sizeof *d);
+      if (d == NULL)
+        goto done;
+      d->dir = dir;
+      strlcpy (d->name, name, sizeof d->name);
+      hash_insert (&dentries, &d->hash_elem);
+    }
+  d->sector = sector;
+  list_push_front (&lru_list, &d->lru_elem);
+
+ done:
+  lock_release (&dcache_lock);
+}
+
+/** Forgets anything cached about NAME in the directory whose inode
+   is in sector DIR. */
+void
+dcache_invalidate (block_sector_t dir, const char *name) 
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    {
+      hash_delete (&dentries, &d->hash_elem);
+      list_remove (&d->lru_elem);
+      free (d);
+    }
+  lock_release (&dcache_lock);
+}
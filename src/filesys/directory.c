@@ -1,16 +1,54 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
-/** A directory. */
+/** A directory.
+
+   A directory is a hash table of directory entries.  Its file is
+   an array of buckets, one per sector, each holding BUCKET_ENTRIES
+   entries, and the number of buckets, always a power of 2, is the
+   file's length divided by the sector size.  An entry goes in the
+   bucket that its name hashes to or, if that bucket is full, in
+   the first bucket after it with a free slot, wrapping around at
+   the end.
+
+   A slot is either in use, deleted, or has never been used, which
+   leaves its name empty.  Deleted slots may be reused, but a
+   lookup has to go past them: it stops only at the name, or at a
+   slot that has never been used, since no entry was ever placed
+   past one.  An insertion that would land more than MAX_PROBE
+   buckets past its own doubles the number of buckets and moves
+   every entry to its new place, which also clears out deleted
+   slots.
+
+   The bytes left over at the end of the first bucket count the
+   slots in use and the deleted ones.  An insertion that finds the
+   two together past MAX_LOAD of all the slots also rebuilds the
+   table, in place unless most of those slots are in use, so that
+   deleted slots cannot pile up until every failed lookup searches
+   the whole directory.
+
+   Every directory has an entry named "..", made along with it,
+   for its parent directory; the root directory is its own parent.
+   No entry is named ".": that name always refers to the directory
+   itself.
+
+   Each of the operations below holds the directory's lock, from
+   inode_lock_dir(), for its duration, so that they are atomic with
+   respect to each other.  dir_remove() also locks the directory
+   being removed, while holding its parent's lock; nothing locks a
+   directory's parent while holding its lock. */
 struct dir 
   {
     struct inode *inode;                /**< Backing store. */
-    off_t pos;                          /**< Current position. */
+    off_t pos;                          /**< Slot for dir_readdir(). */
   };
 
 /** A single directory entry. */
@@ -21,12 +59,105 @@ struct dir_entry
     bool in_use;                        /**< In use or free? */
   };
 
+/** Directory entries per bucket. */
+#define BUCKET_ENTRIES (BLOCK_SECTOR_SIZE / sizeof (struct dir_entry))
+
+/** Slot counts, at byte offset COUNTS_OFS in a directory's file. */
+struct dir_counts
+  {
+    uint32_t live_cnt;                  /**< Slots in use. */
+    uint32_t dead_cnt;                  /**< Deleted slots. */
+  };
+#define COUNTS_OFS (BUCKET_ENTRIES * sizeof (struct dir_entry))
+
+/** Farthest past its own bucket that an entry is put without
+   growing the directory first. */
+#define MAX_PROBE 2
+
+/** Most slots, in use or deleted, out of 4 before an insertion
+   rebuilds the table. */
+#define MAX_LOAD 3
+
+/** Returns the number of buckets in DIR. */
+static size_t
+bucket_cnt (const struct dir *dir) 
+{
+  return inode_length (dir->inode) / BLOCK_SECTOR_SIZE;
+}
+
+/** Returns the byte offset in a directory's file of slot SLOT in
+   bucket BUCKET. */
+static off_t
+slot_ofs (size_t bucket, size_t slot) 
+{
+  return bucket * BLOCK_SECTOR_SIZE + slot * sizeof (struct dir_entry);
+}
+
+/** Reads DIR's slot counts into *COUNTS. */
+static void
+read_counts (const struct dir *dir, struct dir_counts *counts) 
+{
+  if (inode_read_at (dir->inode, counts, sizeof *counts, COUNTS_OFS)
+      != sizeof *counts)
+    memset (counts, 0, sizeof *counts);
+}
+
+/** Writes COUNTS as DIR's slot counts. */
+static void
+write_counts (struct dir *dir, const struct dir_counts *counts) 
+{
+  inode_write_at (dir->inode, counts, sizeof *counts, COUNTS_OFS);
+}
+
+static bool rehash (struct dir *, size_t new_cnt);
+static bool add_entry (struct dir *, const char *name, block_sector_t);
+
+/** Returns true if NAME is "." or "..", false otherwise. */
+static bool
+is_dot (const char *name) 
+{
+  return !strcmp (name, ".") || !strcmp (name, "..");
+}
+
 /** Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR, which the caller allocated, within the directory
+   whose inode is in sector PARENT.  Returns true if successful,
+   false on failure, in which case SECTOR and anything allocated
+   for the directory are released. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, block_sector_t parent,
+            size_t entry_cnt)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  size_t buckets = 1;
+  struct inode *inode;
+  struct dir dir;
+  bool success;
+
+  ASSERT (COUNTS_OFS + sizeof (struct dir_counts) <= BLOCK_SECTOR_SIZE);
+
+  /* Create the directory empty and open it before giving it any
+     buckets, so that once it has some, removing it frees them. */
+  inode = inode_create (sector, 0, true) ? inode_open (sector) : NULL;
+  if (inode == NULL)
+    {
+      free_map_release (sector, 1);
+      return false;
+    }
+
+  /* Start out at most half full, counting "..". */
+  entry_cnt++;
+  while (buckets * BUCKET_ENTRIES < entry_cnt * 2)
+    buckets *= 2;
+
+  dir.inode = inode;
+  dir.pos = 0;
+  inode_lock_dir (inode);
+  success = rehash (&dir, buckets) && add_entry (&dir, "..", parent);
+  inode_unlock_dir (inode);
+  if (!success)
+    inode_remove (inode);
+  inode_close (inode);
+  return success;
 }
 
 /** Opens and returns the directory for the given INODE, of which
@@ -87,47 +218,137 @@ dir_get_inode (struct dir *dir)
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   otherwise, returns false and ignores EP and OFSP.
+   Either way, if FREEP is non-null, sets *FREEP to the byte
+   offset of the first free slot that the search passed, or -1 if
+   it passed none, and *PROBEP to the number of buckets between
+   that slot's bucket and NAME's own. */
 static bool
 lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp) 
+        struct dir_entry *ep, off_t *ofsp, off_t *freep, size_t *probep) 
 {
-  struct dir_entry e;
-  size_t ofs;
+  size_t cnt = bucket_cnt (dir);
+  size_t home = hash_string (name) & (cnt - 1);
+  size_t i;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
+  if (freep != NULL)
+    *freep = -1;
+  for (i = 0; i < cnt; i++) 
+    {
+      size_t bucket = (home + i) & (cnt - 1);
+      size_t slot;
+
+      for (slot = 0; slot < BUCKET_ENTRIES; slot++)
+        {
+          off_t ofs = slot_ofs (bucket, slot);
+          struct dir_entry e;
+
+          if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+            return false;
+          if (e.in_use && !strcmp (name, e.name)) 
+            {
+              if (ep != NULL)
+                *ep = e;
+              if (ofsp != NULL)
+                *ofsp = ofs;
+              return true;
+            }
+          if (!e.in_use && freep != NULL && *freep == -1)
+            {
+              *freep = ofs;
+              *probep = i;
+            }
+          if (!e.in_use && e.name[0] == '\0')
+            return false;
+        }
+    }
+  return false;
+}
+
+/** Rebuilds DIR as a table of NEW_CNT buckets, at least as many
+   as it has now, moving each entry into its place and dropping
+   deleted slots.  Returns true if successful, false if memory or
+   disk space runs out, in which case DIR is unchanged. */
+static bool
+rehash (struct dir *dir, size_t new_cnt) 
+{
+  static const char zeros[BLOCK_SECTOR_SIZE];
+  size_t old_cnt = bucket_cnt (dir);
+  size_t entry_cnt = old_cnt * BUCKET_ENTRIES;
+  struct dir_counts counts = {0, 0};
+  struct dir_entry *entries;
+  size_t i;
+
+  ASSERT (new_cnt >= old_cnt);
+
+  /* Make sure that none of the writes below can fail. */
+  if (!inode_reserve (dir->inode, new_cnt * BLOCK_SECTOR_SIZE))
+    return false;
+  entries = malloc (entry_cnt * sizeof *entries);
+  if (entries == NULL && entry_cnt > 0)
+    return false;
+  for (i = 0; i < old_cnt; i++)
+    inode_read_at (dir->inode, entries + i * BUCKET_ENTRIES,
+                   BUCKET_ENTRIES * sizeof *entries, slot_ofs (i, 0));
+
+  /* Empty all of the buckets, old and new, then put the entries
+     back. */
+  for (i = 0; i < new_cnt; i++)
+    inode_write_at (dir->inode, zeros, BLOCK_SECTOR_SIZE,
+                    i * BLOCK_SECTOR_SIZE);
+  for (i = 0; i < entry_cnt; i++)
+    if (entries[i].in_use)
       {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
+        off_t ofs;
+        size_t probe;
+
+        lookup (dir, entries[i].name, NULL, NULL, &ofs, &probe);
+        ASSERT (ofs != -1);
+        inode_write_at (dir->inode, &entries[i], sizeof entries[i], ofs);
+        counts.live_cnt++;
       }
-  return false;
+  write_counts (dir, &counts);
+
+  free (entries);
+  return true;
 }
 
 /** Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.
+   NAME may be "." for DIR itself or ".." for its parent.
+   Consults the directory entry cache first, and records what the
+   search found there. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t dir_sector;
+  block_sector_t sector;
   struct dir_entry e;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  if (!strcmp (name, "."))
+    {
+      *inode = inode_reopen (dir->inode);
+      return true;
+    }
+
+  dir_sector = inode_get_inumber (dir->inode);
+  inode_lock_dir (dir->inode);
+  if (!dcache_lookup (dir_sector, name, &sector))
+    {
+      sector = lookup (dir, name, &e, NULL, NULL, NULL) ? e.inode_sector : 0;
+      dcache_insert (dir_sector, name, sector);
+    }
+  *inode = sector != 0 ? inode_open (sector) : NULL;
+  inode_unlock_dir (dir->inode);
 
   return *inode != NULL;
 }
@@ -136,54 +357,111 @@ dir_lookup (const struct dir *dir, const char *name,
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
    Returns true if successful, false on failure.
-   Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
+   Fails if NAME is invalid (i.e. too long, "." or "..") or a disk
+   or memory error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
-  struct dir_entry e;
-  off_t ofs;
-  bool success = false;
+  bool success;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
   /* Check NAME for validity. */
-  if (*name == '\0' || strlen (name) > NAME_MAX)
+  if (*name == '\0' || strlen (name) > NAME_MAX || is_dot (name))
     return false;
 
-  /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  inode_lock_dir (dir->inode);
+  success = add_entry (dir, name, inode_sector);
+  inode_unlock_dir (dir->inode);
+  return success;
+}
+
+/** Adds an entry for NAME, which must be valid, to DIR, pointing
+   to the inode in INODE_SECTOR.  Fails if DIR already has an
+   entry for NAME or a disk or memory error occurs.  DIR must be
+   locked. */
+static bool
+add_entry (struct dir *dir, const char *name, block_sector_t inode_sector)
+{
+  struct dir_counts counts;
+  struct dir_entry e;
+  size_t buckets = bucket_cnt (dir);
+  size_t slots = buckets * BUCKET_ENTRIES;
+  off_t ofs;
+  size_t probe;
+  bool rebuild = false;
+  bool success = false;
+
+  /* Check that NAME is not in use, and find a free slot for it
+     along the way.  If the slot is too far from NAME's own bucket,
+     or there is none, grow DIR and look again.  If too many slots
+     are in use or deleted, rebuild DIR, growing it only if most
+     of them are in use. */
+  if (lookup (dir, name, NULL, NULL, &ofs, &probe))
+    goto done;
+  read_counts (dir, &counts);
+  if (ofs == -1 || probe > MAX_PROBE)
+    {
+      buckets *= 2;
+      rebuild = true;
+    }
+  else if ((counts.live_cnt + counts.dead_cnt + 1) * 4 > slots * MAX_LOAD)
+    {
+      if ((counts.live_cnt + 1) * 2 > slots)
+        buckets *= 2;
+      rebuild = true;
+    }
+  if (rebuild && rehash (dir, buckets))
+    {
+      lookup (dir, name, NULL, NULL, &ofs, &probe);
+      read_counts (dir, &counts);
+    }
+  if (ofs == -1)
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
+  /* Write slot, reusing it if it was deleted. */
+  if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+    goto done;
+  if (e.name[0] != '\0')
+    counts.dead_cnt--;
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  if (success)
+    {
+      counts.live_cnt++;
+      write_counts (dir, &counts);
+    }
 
  done:
   return success;
 }
 
+/** Returns true if the directory with the given INODE has no
+   entries besides "..", false otherwise. */
+static bool
+is_empty (struct inode *inode) 
+{
+  struct dir dir = {inode, 0};
+  char name[NAME_MAX + 1];
+
+  return !dir_readdir (&dir, name);
+}
+
 /** Removes any entry for NAME in DIR.
-   Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   Returns true if successful, false on failure, which occurs if
+   there is no file with the given NAME, if NAME is "." or "..",
+   or if it names a directory that is not empty or that is open,
+   for example as some process's working directory.  The last two
+   rules also keep the root directory, and the directory entry
+   cache, from ever referring to a directory that is gone. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
+  struct dir_counts counts;
   struct dir_entry e;
   struct inode *inode = NULL;
   bool success = false;
@@ -192,45 +470,70 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (is_dot (name))
+    return false;
+  inode_lock_dir (dir->inode);
+
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  if (!lookup (dir, name, &e, &ofs, NULL, NULL))
     goto done;
 
   /* Open inode. */
   inode = inode_open (e.inode_sector);
   if (inode == NULL)
     goto done;
+  if (inode_is_dir (inode)
+      && (inode_open_cnt (inode) > 1 || !is_empty (inode)))
+    goto done;
 
-  /* Erase directory entry. */
+  /* Erase directory entry, keeping its name so that lookups go on
+     past it. */
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
+  read_counts (dir, &counts);
+  counts.live_cnt--;
+  counts.dead_cnt++;
+  write_counts (dir, &counts);
 
   /* Remove inode. */
   inode_remove (inode);
   success = true;
 
  done:
+  inode_unlock_dir (dir->inode);
   inode_close (inode);
   return success;
 }
 
-/** Reads the next directory entry in DIR and stores the name in
-   NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+/** Reads the next directory entry in DIR, other than "..", and
+   stores the name in NAME.  Returns true if successful, false if
+   the directory contains no more entries.  If DIR grows in the meantime, its
+   entries move, so that one may be returned twice or not at
+   all. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
+  bool success = false;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  inode_lock_dir (dir->inode);
+  while ((size_t) dir->pos < bucket_cnt (dir) * BUCKET_ENTRIES)
     {
-      dir->pos += sizeof e;
-      if (e.in_use)
+      off_t ofs = slot_ofs (dir->pos / BUCKET_ENTRIES,
+                            dir->pos % BUCKET_ENTRIES);
+
+      if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+        break;
+      dir->pos++;
+      if (e.in_use && strcmp (e.name, ".."))
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          success = true;
+          break;
         } 
     }
-  return false;
+  inode_unlock_dir (dir->inode);
+  return success;
 }
@@ -1,14 +1,26 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include "devices/block.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
-/** An open file. */
+/** Largest read-ahead window, in sectors. */
+#define READAHEAD_MAX 16
+
+/** An open file.  The threads of a process share its open files,
+   so `lock' protects the position and the read-ahead state. */
 struct file 
   {
     struct inode *inode;        /**< File's inode. */
+    struct lock lock;           /**< Protects the members below. */
     off_t pos;                  /**< Current position. */
     bool deny_write;            /**< Has file_deny_write() been called? */
+
+    /* Sequential read detection, for read-ahead. */
+    off_t ra_pos;               /**< Where a sequential read would start. */
+    off_t ra_end;               /**< End of bytes queued for read-ahead. */
+    int ra_window;              /**< Read-ahead window, in sectors. */
   };
 
 /** Opens a file for the given INODE, of which it takes ownership,
@@ -21,8 +33,11 @@ file_open (struct inode *inode)
   if (inode != NULL && file != NULL)
     {
       file->inode = inode;
+      lock_init (&file->lock);
       file->pos = 0;
       file->deny_write = false;
+      file->ra_pos = file->ra_end = 0;
+      file->ra_window = 0;
       return file;
     }
   else
@@ -64,12 +79,43 @@ file_get_inode (struct file *file)
    starting at the file's current position.
    Returns the number of bytes actually read,
    which may be less than SIZE if end of file is reached.
-   Advances FILE's position by the number of bytes read. */
+   Advances FILE's position by the number of bytes read.
+
+   A read that starts where the previous one ended doubles FILE's
+   read-ahead window, up to READAHEAD_MAX sectors, and any other
+   read closes it.  Sectors in the window past the new position
+   are then queued for read-ahead into the buffer cache. */
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  off_t bytes_read;
+
+  lock_acquire (&file->lock);
+  if (file->pos == file->ra_pos)
+    file->ra_window = (file->ra_window == 0 ? 1
+                       : file->ra_window < READAHEAD_MAX
+                       ? file->ra_window * 2 : READAHEAD_MAX);
+  else 
+    {
+      file->ra_window = 0;
+      file->ra_end = file->pos;
+    }
+
+  bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
   file->pos += bytes_read;
+  file->ra_pos = file->pos;
+
+  if (file->ra_window > 0) 
+    {
+      off_t start = file->ra_end > file->pos ? file->ra_end : file->pos;
+      off_t end = file->pos + file->ra_window * BLOCK_SECTOR_SIZE;
+      if (start < end)
+        {
+          inode_readahead (file->inode, start, end);
+          file->ra_end = end;
+        }
+    }
+  lock_release (&file->lock);
   return bytes_read;
 }
 
@@ -87,24 +133,26 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 /** Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the file cannot grow enough.
+   Writing past end of file extends the file.
    Advances FILE's position by the number of bytes read. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
 {
-  off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+  off_t bytes_written;
+
+  lock_acquire (&file->lock);
+  bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
   file->pos += bytes_written;
+  lock_release (&file->lock);
   return bytes_written;
 }
 
 /** Writes SIZE bytes from BUFFER into FILE,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the file cannot grow enough.
+   Writing past end of file extends the file.
    The file's current position is unaffected. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
@@ -119,11 +167,13 @@ void
 file_deny_write (struct file *file) 
 {
   ASSERT (file != NULL);
+  lock_acquire (&file->lock);
   if (!file->deny_write) 
     {
       file->deny_write = true;
       inode_deny_write (file->inode);
     }
+  lock_release (&file->lock);
 }
 
 /** Re-enables write operations on FILE's underlying inode.
@@ -133,11 +183,13 @@ void
 file_allow_write (struct file *file) 
 {
   ASSERT (file != NULL);
+  lock_acquire (&file->lock);
   if (file->deny_write) 
     {
       file->deny_write = false;
       inode_allow_write (file->inode);
     }
+  lock_release (&file->lock);
 }
 
 /** Returns the size of FILE in bytes. */
@@ -155,7 +207,9 @@ file_seek (struct file *file, off_t new_pos)
 {
   ASSERT (file != NULL);
   ASSERT (new_pos >= 0);
+  lock_acquire (&file->lock);
   file->pos = new_pos;
+  lock_release (&file->lock);
 }
 
 /** Returns the current position in FILE as a byte offset from the
@@ -163,6 +217,11 @@ file_seek (struct file *file, off_t new_pos)
 off_t
 file_tell (struct file *file) 
 {
+  off_t pos;
+
   ASSERT (file != NULL);
-  return file->pos;
+  lock_acquire (&file->lock);
+  pos = file->pos;
+  lock_release (&file->lock);
+  return pos;
 }
@@ -2,15 +2,23 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#ifdef USERPROG
+#include "userprog/process.h"
+#endif
 
 /** Partition that contains the file system. */
 struct block *fs_device;
 
 static void do_format (void);
+static bool resolve (const char *path, struct dir **,
+                     char name[NAME_MAX + 1]);
+static void release_inode (block_sector_t, bool created);
 
 /** Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -21,6 +29,8 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
+  dcache_init ();
   inode_init ();
   free_map_init ();
 
@@ -36,6 +46,7 @@ void
 filesys_done (void) 
 {
   free_map_close ();
+  cache_flush ();
 }
 
 /** Creates a file named NAME with the given INITIAL_SIZE.
@@ -46,57 +57,246 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+  char base[NAME_MAX + 1];
+  struct dir *dir = NULL;
+  bool created = false;
+  bool success = false;
+
+  if (resolve (name, &dir, base) && free_map_allocate (1, &inode_sector))
+    {
+      created = inode_create (inode_sector, initial_size, false);
+      success = created && dir_add (dir, base, inode_sector);
+    }
   if (!success && inode_sector != 0) 
-    free_map_release (inode_sector, 1);
+    release_inode (inode_sector, created);
+  dir_close (dir);
+
+  return success;
+}
+
+/** Creates a directory named NAME.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char *name) 
+{
+  block_sector_t inode_sector = 0;
+  char base[NAME_MAX + 1];
+  struct dir *dir = NULL;
+  bool success = false;
+
+  /* dir_create() releases INODE_SECTOR itself if it fails. */
+  if (resolve (name, &dir, base) && free_map_allocate (1, &inode_sector))
+    {
+      block_sector_t parent = inode_get_inumber (dir_get_inode (dir));
+
+      if (dir_create (inode_sector, parent, 16))
+        {
+          success = dir_add (dir, base, inode_sector);
+          if (!success)
+            release_inode (inode_sector, true);
+        }
+    }
   dir_close (dir);
 
   return success;
 }
 
+/** Opens the file or directory with the given NAME.
+   Returns its inode if successful or a null pointer otherwise.
+   Fails if no file named NAME exists,
+   or if an internal memory allocation fails. */
+struct inode *
+filesys_open_inode (const char *name)
+{
+  char base[NAME_MAX + 1];
+  struct dir *dir;
+  struct inode *inode = NULL;
+
+  if (resolve (name, &dir, base))
+    {
+      dir_lookup (dir, base, &inode);
+      dir_close (dir);
+    }
+  return inode;
+}
+
 /** Opens the file with the given NAME.
    Returns the new file if successful or a null pointer
    otherwise.
-   Fails if no file named NAME exists,
+   Fails if no file named NAME exists, if NAME is a directory,
    or if an internal memory allocation fails. */
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
-  struct inode *inode = NULL;
-
-  if (dir != NULL)
-    dir_lookup (dir, name, &inode);
-  dir_close (dir);
+  struct inode *inode = filesys_open_inode (name);
 
+  if (inode != NULL && inode_is_dir (inode))
+    {
+      inode_close (inode);
+      return NULL;
+    }
   return file_open (inode);
 }
 
-/** Deletes the file named NAME.
+/** Opens the directory with the given NAME.
+   Returns the new directory if successful or a null pointer
+   otherwise.
+   Fails if no directory named NAME exists,
+   or if an internal memory allocation fails. */
+struct dir *
+filesys_open_dir (const char *name)
+{
+  struct inode *inode = filesys_open_inode (name);
+
+  if (inode != NULL && !inode_is_dir (inode))
+    {
+      inode_close (inode);
+      return NULL;
+    }
+  return dir_open (inode);
+}
+
+/** Deletes the file or empty directory named NAME.
    Returns true if successful, false on failure.
    Fails if no file named NAME exists,
    or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char base[NAME_MAX + 1];
+  struct dir *dir = NULL;
+  bool success = resolve (name, &dir, base) && dir_remove (dir, base);
   dir_close (dir); 
 
   return success;
 }
-
+
+/** Releases SECTOR, which was allocated for a new inode, along
+   with the inode's data if CREATED is true, that is, if the inode
+   was created there. */
+static void
+release_inode (block_sector_t sector, bool created) 
+{
+  struct inode *inode = created ? inode_open (sector) : NULL;
+
+  if (inode != NULL)
+    {
+      inode_remove (inode);
+      inode_close (inode);
+    }
+  else
+    free_map_release (sector, 1);
+}
+
+/** Opens and returns the directory that relative file names start
+   from: the running process's working directory, or the root
+   directory if it has none.  Returns a null pointer if memory is
+   short. */
+static struct dir *
+open_cwd (void) 
+{
+#ifdef USERPROG
+  return process_open_cwd ();
+#else
+  return dir_open_root ();
+#endif
+}
+
+/** Extracts a file name part from *SRCP into PART, and updates
+   *SRCP so that the next call will return the next file name
+   part.  Returns 1 if successful, 0 at end of string, -1 for a
+   too-long file name part. */
+static int
+get_next_part (char part[NAME_MAX + 1], const char **srcp) 
+{
+  const char *src = *srcp;
+  char *dst = part;
+
+  /* Skip leading slashes.  If it's all slashes, we're done. */
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+
+  /* Copy up to NAME_MAX character from SRC to DST.  Add null
+     terminator. */
+  while (*src != '/' && *src != '\0') 
+    {
+      if (dst < part + NAME_MAX)
+        *dst++ = *src;
+      else
+        return -1;
+      src++; 
+    }
+  *dst = '\0';
+
+  /* Advance source pointer. */
+  *srcp = src;
+  return 1;
+}
+
+/** Splits PATH into the directory that holds what it names and
+   that object's name within it.  On success, stores the
+   directory, which the caller must close, into *DIRP, the name
+   into NAME, and returns true.  A PATH with no name at all, such
+   as "/", names the directory it starts from as ".".  PATH is
+   absolute if it begins with "/", otherwise relative to the
+   working directory.  Returns false if PATH is empty, if one of
+   its names is too long, or if a name before the last is not an
+   existing directory. */
+static bool
+resolve (const char *path, struct dir **dirp, char name[NAME_MAX + 1]) 
+{
+  char next[NAME_MAX + 1];
+  struct dir *dir;
+  int result;
+
+  *dirp = NULL;
+  if (*path == '\0')
+    return false;
+  dir = *path == '/' ? dir_open_root () : open_cwd ();
+  if (dir == NULL)
+    return false;
+
+  result = get_next_part (name, &path);
+  if (result == 0)
+    strlcpy (name, ".", NAME_MAX + 1);
+  while (result > 0 && (result = get_next_part (next, &path)) > 0) 
+    {
+      /* NAME is not the last part, so it must be a directory. */
+      struct inode *inode;
+
+      dir_lookup (dir, name, &inode);
+      dir_close (dir);
+      if (inode == NULL || !inode_is_dir (inode)) 
+        {
+          inode_close (inode);
+          return false;
+        }
+      dir = dir_open (inode);
+      if (dir == NULL)
+        return false;
+      strlcpy (name, next, NAME_MAX + 1);
+    }
+  if (result < 0) 
+    {
+      dir_close (dir);
+      return false;
+    }
+
+  *dirp = dir;
+  return true;
+}
+
 /** Formats the file system. */
 static void
 do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
@@ -14,7 +14,10 @@ struct block *fs_device;
 void filesys_init (bool format);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
+bool filesys_mkdir (const char *name);
+struct inode *filesys_open_inode (const char *name);
 struct file *filesys_open (const char *name);
+struct dir *filesys_open_dir (const char *name);
 bool filesys_remove (const char *name);
 
 #endif /**< filesys/filesys.h */
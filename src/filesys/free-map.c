@@ -1,12 +1,95 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/** The free map is divided into groups of GROUP_SECTORS sectors,
+   and for each group the number of free sectors it holds is kept
+   in memory.  Searches skip over full groups without looking at
+   their bits. */
+#define GROUP_SECTORS 512
 
 static struct file *free_map_file;   /**< Free map file. */
 static struct bitmap *free_map;      /**< Free map, one bit per sector. */
+static size_t *group_free;           /**< Free sectors in each group. */
+static size_t group_cnt;             /**< Number of groups. */
+static size_t next_fit;              /**< Where the next search starts. */
+static struct lock free_map_lock;    /**< Protects all of the above. */
+
+/** Recounts the free sectors in every group. */
+static void
+count_groups (void) 
+{
+  size_t sector_cnt = bitmap_size (free_map);
+  size_t g;
+
+  for (g = 0; g < group_cnt; g++)
+    {
+      size_t start = g * GROUP_SECTORS;
+      size_t cnt = (sector_cnt - start < GROUP_SECTORS
+                    ? sector_cnt - start : GROUP_SECTORS);
+      group_free[g] = bitmap_count (free_map, start, cnt, false);
+    }
+}
+
+/** Sets the CNT sectors starting at SECTOR to VALUE, which is true
+   for "in use", in the free map, keeping the group counts up to
+   date.  Each sector must not already have that value.  Writes the
+   changed part of the free map to the free map file, if it is
+   open, and returns true if successful. */
+static bool
+set_sectors (block_sector_t sector, size_t cnt, bool value) 
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      size_t g = (sector + i) / GROUP_SECTORS;
+
+      ASSERT (bitmap_test (free_map, sector + i) != value);
+      bitmap_set (free_map, sector + i, value);
+      if (value)
+        group_free[g]--;
+      else
+        group_free[g]++;
+    }
+  return (free_map_file == NULL
+          || bitmap_write_range (free_map, free_map_file, sector, cnt));
+}
+
+/** Returns the first sector at or after START that begins a run of
+   CNT free sectors, or BITMAP_ERROR if there is none. */
+static size_t
+find_run (size_t start, size_t cnt) 
+{
+  size_t sector_cnt = bitmap_size (free_map);
+  size_t sector = start;
+
+  while (sector + cnt <= sector_cnt)
+    {
+      size_t run;
+
+      if (group_free[sector / GROUP_SECTORS] == 0)
+        {
+          /* Skip the rest of a full group. */
+          sector = ROUND_DOWN (sector, GROUP_SECTORS) + GROUP_SECTORS;
+          continue;
+        }
+
+      for (run = 0; run < cnt; run++)
+        if (bitmap_test (free_map, sector + run))
+          break;
+      if (run == cnt)
+        return sector;
+      sector += run + 1;
+    }
+  return BITMAP_ERROR;
+}
 
 /** Initializes the free map. */
 void
@@ -15,38 +98,73 @@ free_map_init (void)
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  group_cnt = DIV_ROUND_UP (bitmap_size (free_map), GROUP_SECTORS);
+  group_free = malloc (group_cnt * sizeof *group_free);
+  if (group_free == NULL)
+    PANIC ("free map summary creation failed");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  count_groups ();
+  lock_init (&free_map_lock);
 }
 
 /** Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  The search starts where the previous
+   one left off and wraps around to the start of the disk.
    Returns true if successful, false if not enough consecutive
    sectors were available or if the free_map file could not be
    written. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  return free_map_allocate_near (cnt, (block_sector_t) -1, sectorp);
+}
+
+/** Allocates CNT consecutive sectors from the free map, as close
+   after sector GOAL as possible, and stores the first into
+   *SECTORP.  Callers extending a file should pass the sector just
+   past the file's data, so that the file stays contiguous.  A GOAL
+   past the end of the disk starts the search where the previous
+   one left off.
+   Returns true if successful, false if not enough consecutive
+   sectors were available or if the free_map file could not be
+   written. */
+bool
+free_map_allocate_near (size_t cnt, block_sector_t goal,
+                        block_sector_t *sectorp)
+{
+  size_t sector;
+  bool success = false;
+
+  lock_acquire (&free_map_lock);
+  if (goal >= bitmap_size (free_map))
+    goal = next_fit < bitmap_size (free_map) ? next_fit : 0;
+  sector = find_run (goal, cnt);
+  if (sector == BITMAP_ERROR && goal > 0)
+    sector = find_run (0, cnt);
+  if (sector != BITMAP_ERROR)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      if (set_sectors (sector, cnt, true))
+        {
+          next_fit = sector + cnt;
+          *sectorp = sector;
+          success = true;
+        }
+      else
+        set_sectors (sector, cnt, false);
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  lock_release (&free_map_lock);
+  return success;
 }
 
 /** Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  set_sectors (sector, cnt, false);
+  lock_release (&free_map_lock);
 }
 
 /** Opens the free map file and reads it from disk. */
@@ -58,6 +176,7 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  count_groups ();
 }
 
 /** Writes the free map to disk and closes the free map file. */
@@ -73,7 +192,7 @@ void
 free_map_create (void) 
 {
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
@@ -3,21 +3,62 @@
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#ifdef USERPROG
+#include "userprog/process.h"
+#endif
 
 /** Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/** Layout of a file's data sectors.
+
+   The on-disk inode holds the numbers of the file's first
+   DIRECT_CNT data sectors itself.  Past those, it points to an
+   indirect block, a sector full of the numbers of the next
+   PTRS_PER_SECTOR data sectors, and then to a doubly indirect
+   block, a sector full of the numbers of indirect blocks.
+
+   Sector number 0, which always holds the free map's inode, is
+   never a data or index sector, so a 0 entry means that nothing
+   is allocated there.  A file may have such holes anywhere, for
+   example where a write went past the end of the file.  Holes
+   read as zeros and take no space until they are written.
+
+   Sectors are handed out in runs: a write that needs several new
+   sectors gets consecutive ones when the free map has them, and a
+   write that extends the file also allocates the next
+   PREALLOC_SECTORS sectors past its end, so that the appends that
+   typically follow find their sectors already allocated right
+   after the file's data, even while other files are growing too.
+   Sectors preallocated this way but still past end of file are
+   released when the file is last closed.
+
+   A data sector allocated this way is not zeroed on disk.  Its
+   entry carries the UNWRITTEN flag instead, and it reads as zeros
+   until the first write to it, which zeros whatever part of it
+   that write does not cover.  Index blocks are always zeroed. */
+#define DIRECT_CNT 123
+#define PTRS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+#define INODE_MAX_SECTORS (DIRECT_CNT + PTRS_PER_SECTOR              \
+                           + PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+#define PREALLOC_SECTORS 8
+#define UNWRITTEN 0x80000000u   /**< Flag in a data sector entry. */
+
 /** On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
   {
-    block_sector_t start;               /**< First data sector. */
+    block_sector_t direct[DIRECT_CNT];  /**< First data sectors. */
+    block_sector_t indirect;            /**< Indirect block. */
+    block_sector_t doubly_indirect;     /**< Doubly indirect block. */
     off_t length;                       /**< File size in bytes. */
+    uint32_t is_dir;                    /**< Nonzero for a directory. */
     unsigned magic;                     /**< Magic number. */
-    uint32_t unused[125];               /**< Not used. */
   };
 
 /** Returns the number of sectors to allocate for an inode SIZE
@@ -28,49 +69,290 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
-/** In-memory inode. */
+/** A sector's worth of zeros. */
+static char zeros[BLOCK_SECTOR_SIZE];
+
+/** Value for the FILL argument to the functions below that asks
+   for a newly allocated sector full of zeros. */
+#define FRESH_SECTOR ((block_sector_t) -1)
+
+/** If *SLOTP is 0 and FILL is not, stores FILL into *SLOTP, or
+   if FILL is FRESH_SECTOR, allocates a sector, fills it with
+   zeros, and stores its number instead.
+   Returns false if an allocation was needed and failed. */
+static bool
+fill_slot (block_sector_t *slotp, block_sector_t fill)
+{
+  if (*slotp == 0 && fill != 0)
+    {
+      if (fill != FRESH_SECTOR)
+        *slotp = fill;
+      else if (free_map_allocate (1, slotp))
+        cache_write (*slotp, zeros, 0, BLOCK_SECTOR_SIZE);
+      else
+        return false;
+    }
+  return true;
+}
+
+/** Stores entry IDX of index block INDEX into *SECTORP, first
+   filling the entry as fill_slot() does if it is 0.  INDEX may be
+   0, for an index block that does not exist, if FILL is 0.
+   Returns false if an allocation was needed and failed. */
+static bool
+fill_entry (block_sector_t index, size_t idx, block_sector_t fill,
+            block_sector_t *sectorp)
+{
+  size_t ofs = idx * sizeof *sectorp;
+
+  if (index == 0)
+    {
+      ASSERT (fill == 0);
+      *sectorp = 0;
+      return true;
+    }
+
+  cache_read (index, sectorp, ofs, sizeof *sectorp);
+  if (*sectorp == 0 && fill != 0)
+    {
+      if (!fill_slot (sectorp, fill))
+        return false;
+      cache_write (index, sectorp, ofs, sizeof *sectorp);
+    }
+  return true;
+}
+
+/** Stores into *SECTORP the number of the sector that holds data
+   sector IDX of the file whose on-disk inode is DATA, or 0 if
+   there is a hole there.  If FILL is nonzero, a hole is first
+   filled as fill_slot() does, allocating any missing index blocks
+   on the way to it; the caller must then write DATA back to disk.
+   Returns false if an allocation was needed and failed. */
+static bool
+lookup_sector (struct inode_disk *data, size_t idx, block_sector_t fill,
+               block_sector_t *sectorp)
+{
+  block_sector_t index_fill = fill != 0 ? FRESH_SECTOR : 0;
+  block_sector_t index;
+
+  ASSERT (idx < INODE_MAX_SECTORS);
+
+  if (idx < DIRECT_CNT)
+    {
+      if (!fill_slot (&data->direct[idx], fill))
+        return false;
+      *sectorp = data->direct[idx];
+      return true;
+    }
+  idx -= DIRECT_CNT;
+
+  if (idx < PTRS_PER_SECTOR)
+    return (fill_slot (&data->indirect, index_fill)
+            && fill_entry (data->indirect, idx, fill, sectorp));
+  idx -= PTRS_PER_SECTOR;
+
+  return (fill_slot (&data->doubly_indirect, index_fill)
+          && fill_entry (data->doubly_indirect, idx / PTRS_PER_SECTOR,
+                         index_fill, &index)
+          && fill_entry (index, idx % PTRS_PER_SECTOR, fill, sectorp));
+}
+
+/** Replaces the entry for data sector IDX, which must not be a
+   hole, of the file whose on-disk inode is DATA by SECTOR, without
+   releasing the sector it held.  SECTOR may be 0, turning the
+   entry back into a hole.  The caller must then write DATA back
+   to disk. */
+static void
+set_sector (struct inode_disk *data, size_t idx, block_sector_t sector)
+{
+  block_sector_t index;
+
+  ASSERT (idx < INODE_MAX_SECTORS);
+
+  if (idx < DIRECT_CNT)
+    {
+      data->direct[idx] = sector;
+      return;
+    }
+  idx -= DIRECT_CNT;
+
+  if (idx < PTRS_PER_SECTOR)
+    index = data->indirect;
+  else
+    {
+      idx -= PTRS_PER_SECTOR;
+      fill_entry (data->doubly_indirect, idx / PTRS_PER_SECTOR, 0, &index);
+      idx %= PTRS_PER_SECTOR;
+    }
+  if (index != 0)
+    cache_write (index, &sector, idx * sizeof sector, sizeof sector);
+}
+
+/** Fills the holes among data sectors FIRST through LAST,
+   inclusive, of the file whose on-disk inode is DATA with newly
+   allocated sectors, marked UNWRITTEN.  Each run of consecutive
+   holes gets a run of consecutive sectors, or as long a run as the
+   free map can provide, so that the file's data stays contiguous
+   on disk.
+   A run is placed just after the data sector that precedes it in
+   the file, if there is one, and otherwise as close after sector
+   GOAL as possible.
+   Returns true if successful, false if the disk fills up first.
+   Sets *CHANGEDP to true if any sector was allocated, in which
+   case the caller must write DATA back to disk. */
+static bool
+allocate_runs (struct inode_disk *data, size_t first, size_t last,
+               block_sector_t goal, bool *changedp)
+{
+  size_t idx = first;
+
+  while (idx <= last)
+    {
+      block_sector_t sector, prev, start;
+      size_t cnt, i;
+
+      lookup_sector (data, idx, 0, &sector);
+      if (sector != 0)
+        {
+          idx++;
+          continue;
+        }
+
+      /* Count the holes in this run, then get as many consecutive
+         sectors for them as we can. */
+      for (cnt = 1; idx + cnt <= last; cnt++)
+        {
+          lookup_sector (data, idx + cnt, 0, &sector);
+          if (sector != 0)
+            break;
+        }
+      prev = 0;
+      if (idx > 0)
+        lookup_sector (data, idx - 1, 0, &prev);
+      prev &= ~UNWRITTEN;
+      while (!free_map_allocate_near (cnt, prev != 0 ? prev + 1 : goal,
+                                      &start))
+        if ((cnt /= 2) == 0)
+          return false;
+
+      for (i = 0; i < cnt; i++)
+        {
+          if (!lookup_sector (data, idx + i, (start + i) | UNWRITTEN,
+                              &sector))
+            {
+              free_map_release (start + i, cnt - i);
+              return false;
+            }
+          *changedp = true;
+        }
+      idx += cnt;
+    }
+  return true;
+}
+
+/** Releases SECTOR, which is an index block LEVELS levels above the
+   data if LEVELS is nonzero, along with all the sectors it points
+   to.  Does nothing if SECTOR is 0. */
+static void
+release_tree (block_sector_t sector, int levels)
+{
+  if (sector == 0)
+    return;
+  if (levels > 0)
+    {
+      size_t i;
+
+      for (i = 0; i < PTRS_PER_SECTOR; i++)
+        {
+          block_sector_t entry;
+
+          cache_read (sector, &entry, i * sizeof entry, sizeof entry);
+          release_tree (entry, levels - 1);
+        }
+    }
+  free_map_release (sector & ~UNWRITTEN, 1);
+}
+
+/** Releases all of the data and index sectors of the file whose
+   on-disk inode is DATA. */
+static void
+release_sectors (const struct inode_disk *data)
+{
+  size_t i;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    release_tree (data->direct[i], 0);
+  release_tree (data->indirect, 1);
+  release_tree (data->doubly_indirect, 2);
+}
+
+/** In-memory inode.  Members marked [O] are protected by
+   open_inodes_lock, and those marked [L] by the inode's `lock'.
+
+   `lock' is held while a write changes the file, but a read holds
+   it only to find each sector, not while reading the sector, so
+   that readers of a file do not wait for each other's disk reads.
+   That is safe because, while a file is open, each byte's sector
+   can only change from a hole to an allocated sector. */
 struct inode 
   {
-    struct list_elem elem;              /**< Element in inode list. */
+    struct list_elem elem;              /**< Element in inode list. [O] */
     block_sector_t sector;              /**< Sector number of disk location. */
-    int open_cnt;                       /**< Number of openers. */
-    bool removed;                       /**< True if deleted, false otherwise. */
-    int deny_write_cnt;                 /**< 0: writes ok, >0: deny writes. */
-    struct inode_disk data;             /**< Inode content. */
+    int open_cnt;                       /**< Number of openers. [O] */
+    struct lock lock;                   /**< Protects members marked [L]. */
+    struct lock dir_lock;               /**< See inode_lock_dir(). */
+    bool removed;                       /**< Has it been deleted? [L] */
+    int deny_write_cnt;                 /**< 0: writes ok, >0: deny. [L] */
+    unsigned write_cnt;                 /**< Number of writes so far. [L] */
+    bool exec_cached;                   /**< See inode_mark_exec(). [L] */
+    size_t prealloc_end;                /**< End of preallocation. [L] */
+    struct inode_disk data;             /**< Inode content. [L] */
   };
 
 /** Returns the block device sector that contains byte offset POS
    within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   Returns 0 if INODE does not contain data for a byte at offset
+   POS, either because POS is past the end of the file or because
+   it falls in a hole or an UNWRITTEN sector, which read as
+   zeros. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos) 
 {
+  block_sector_t sector;
+
   ASSERT (inode != NULL);
   if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+    {
+      lookup_sector (&inode->data, pos / BLOCK_SECTOR_SIZE, 0, &sector);
+      return sector & UNWRITTEN ? 0 : sector;
+    }
   else
-    return -1;
+    return 0;
 }
 
 /** List of open inodes, so that opening a single inode twice
    returns the same `struct inode'. */
 static struct list open_inodes;
+static struct lock open_inodes_lock;
 
 /** Initializes the inode module. */
 void
 inode_init (void) 
 {
   list_init (&open_inodes);
+  lock_init (&open_inodes_lock);
 }
 
-/** Initializes an inode with LENGTH bytes of data and
+/** Initializes an inode with LENGTH bytes of data, for a
+   directory if IS_DIR is true or an ordinary file otherwise, and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  Allocates sectors for all LENGTH bytes, which read as
+   zeros until written, so that the free map, whose writes must not
+   allocate, can be created this way.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -85,21 +367,19 @@ inode_create (block_sector_t sector, off_t length)
   if (disk_inode != NULL)
     {
       size_t sectors = bytes_to_sectors (length);
+      bool changed = false;
+
       disk_inode->length = length;
+      disk_inode->is_dir = is_dir;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+      success = sectors == 0 || (sectors <= INODE_MAX_SECTORS
+                                 && allocate_runs (disk_inode, 0,
+                                                   sectors - 1, sector + 1,
+                                                   &changed));
+      if (success)
+        cache_write (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+      else
+        release_sectors (disk_inode);
       free (disk_inode);
     }
   return success;
@@ -115,13 +395,15 @@ inode_open (block_sector_t sector)
   struct inode *inode;
 
   /* Check whether this inode is already open. */
+  lock_acquire (&open_inodes_lock);
   for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
        e = list_next (e)) 
     {
       inode = list_entry (e, struct inode, elem);
       if (inode->sector == sector) 
         {
-          inode_reopen (inode);
+          inode->open_cnt++;
+          lock_release (&open_inodes_lock);
           return inode; 
         }
     }
@@ -129,15 +411,30 @@ inode_open (block_sector_t sector)
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
   /* Initialize. */
   list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
+  lock_init (&inode->lock);
+  lock_init (&inode->dir_lock);
   inode->deny_write_cnt = 0;
+  inode->write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->exec_cached = false;
+  inode->prealloc_end = 0;
+
+  /* Read in the on-disk inode without holding up other opens.
+     Anyone who opens it meanwhile waits on its lock before looking
+     at its data. */
+  lock_acquire (&inode->lock);
+  lock_release (&open_inodes_lock);
+  cache_read (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  lock_release (&inode->lock);
   return inode;
 }
 
@@ -146,7 +443,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -157,32 +458,80 @@ inode_get_inumber (const struct inode *inode)
   return inode->sector;
 }
 
+/** Releases the sectors that INODE preallocated past its end of
+   file, if any. */
+static void
+release_prealloc (struct inode *inode) 
+{
+  size_t idx;
+
+  if (inode->prealloc_end == 0)
+    return;
+  for (idx = bytes_to_sectors (inode->data.length);
+       idx < inode->prealloc_end; idx++)
+    {
+      block_sector_t sector;
+
+      lookup_sector (&inode->data, idx, 0, &sector);
+      if (sector != 0)
+        {
+          set_sector (&inode->data, idx, 0);
+          free_map_release (sector & ~UNWRITTEN, 1);
+        }
+    }
+  cache_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+}
+
 /** Closes INODE and writes it to disk.
    If this was the last reference to INODE, frees its memory.
    If INODE was also a removed inode, frees its blocks. */
 void
 inode_close (struct inode *inode) 
 {
+  bool removed;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  lock_acquire (&open_inodes_lock);
+  if (--inode->open_cnt > 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
-      if (inode->removed) 
-        {
-          free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
-        }
+      lock_release (&open_inodes_lock);
+      return;
+    }
 
-      free (inode); 
+  /* Remove from inode list.  Nobody else refers to INODE any
+     longer, so its own lock is not needed.  Preallocated sectors
+     are released before open_inodes_lock is, so that opening the
+     inode again cannot read it back before the release is
+     written. */
+  list_remove (&inode->elem);
+  removed = inode->removed;
+  if (!removed)
+    release_prealloc (inode);
+  lock_release (&open_inodes_lock);
+
+  /* Deallocate blocks if removed.  Its directory entry is gone, so
+     nobody can open it again, and its sector is released last so
+     that it cannot be reused before then. */
+  if (removed) 
+    {
+      release_sectors (&inode->data);
+      free_map_release (inode->sector, 1);
     }
+  free (inode); 
+}
+
+/** Tells the executable image cache that INODE has been written
+   or removed, so that it drops its entry for INODE. */
+static void
+forget_exec (struct inode *inode UNUSED)
+{
+#ifdef USERPROG
+  process_forget_exec (inode);
+#endif
 }
 
 /** Marks INODE to be deleted when it is closed by the last caller who
@@ -190,8 +539,16 @@ inode_close (struct inode *inode)
 void
 inode_remove (struct inode *inode) 
 {
+  bool exec_cached;
+
   ASSERT (inode != NULL);
+  lock_acquire (&inode->lock);
   inode->removed = true;
+  exec_cached = inode->exec_cached;
+  inode->exec_cached = false;
+  lock_release (&inode->lock);
+  if (exec_cached)
+    forget_exec (inode);
 }
 
 /** Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -202,128 +559,207 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      off_t inode_left;
+      int sector_left;
+      int min_left;
+      int chunk_size;
+
+      lock_acquire (&inode->lock);
+      sector_idx = byte_to_sector (inode, offset);
+      inode_left = inode->data.length - offset;
+      lock_release (&inode->lock);
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+      sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      min_left = inode_left < sector_left ? inode_left : sector_left;
 
       /* Number of bytes to actually copy out of this sector. */
-      int chunk_size = size < min_left ? size : min_left;
+      chunk_size = size < min_left ? size : min_left;
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      if (sector_idx != 0)
+        cache_read (sector_idx, buffer + bytes_read, sector_ofs,
+                    chunk_size);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
 
   return bytes_read;
 }
 
 /** Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   A write past the end of the file extends it, allocating sectors
+   only for the bytes written; any gap between the old end of file
+   and OFFSET is left as a hole.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the file reaches its maximum size or the disk
+   is full. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  bool changed = false;
+  bool exec_cached = false;
 
+  lock_acquire (&inode->lock);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      lock_release (&inode->lock);
+      return 0;
+    }
+
+  /* Allocate the sectors the write needs in runs, plus some past
+     its end if it extends the file. */
+  if (size > 0 && (size_t) offset / BLOCK_SECTOR_SIZE < INODE_MAX_SECTORS)
+    {
+      size_t first = offset / BLOCK_SECTOR_SIZE;
+      size_t last = (offset + size - 1) / BLOCK_SECTOR_SIZE;
+
+      if (offset + size > inode->data.length)
+        {
+          last += PREALLOC_SECTORS;
+          if (last >= INODE_MAX_SECTORS)
+            last = INODE_MAX_SECTORS - 1;
+          if (last + 1 > inode->prealloc_end)
+            inode->prealloc_end = last + 1;
+        }
+      allocate_runs (&inode->data, first, last, inode->sector + 1,
+                     &changed);
+    }
 
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      size_t idx = offset / BLOCK_SECTOR_SIZE;
+      block_sector_t sector_idx;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      /* Number of bytes to actually write into this sector. */
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+      int chunk_size = size < sector_left ? size : sector_left;
 
-      /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      /* Find the sector, allocating it if needed. */
+      if (idx >= INODE_MAX_SECTORS)
         break;
-
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      lookup_sector (&inode->data, idx, 0, &sector_idx);
+      if (sector_idx == 0)
         {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
+          changed = true;
+          if (!lookup_sector (&inode->data, idx, FRESH_SECTOR,
+                              &sector_idx))
+            break;
         }
-      else 
+      else if (sector_idx & UNWRITTEN)
         {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
+          /* First write to the sector: zero what it leaves out. */
+          sector_idx &= ~UNWRITTEN;
+          if (chunk_size < BLOCK_SECTOR_SIZE)
+            cache_write (sector_idx, zeros, 0, BLOCK_SECTOR_SIZE);
+          set_sector (&inode->data, idx, sector_idx);
+          changed = true;
         }
 
+      cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+                   chunk_size);
+
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
 
+  if (bytes_written > 0 && offset > inode->data.length)
+    {
+      inode->data.length = offset;
+      changed = true;
+    }
+  if (changed)
+    cache_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  if (bytes_written > 0)
+    {
+      inode->write_cnt++;
+      exec_cached = inode->exec_cached;
+      inode->exec_cached = false;
+    }
+  lock_release (&inode->lock);
+  if (exec_cached)
+    forget_exec (inode);
   return bytes_written;
 }
 
+/** Makes sure that sectors are allocated for the first LENGTH
+   bytes of INODE, without changing its length, so that writes
+   within those bytes cannot run out of space.  Sectors reserved
+   past end of file that are still there when INODE is last closed
+   are released.  Returns true if successful, false if the disk
+   fills up first. */
+bool
+inode_reserve (struct inode *inode, off_t length) 
+{
+  size_t sectors = bytes_to_sectors (length);
+  bool changed = false;
+  bool success;
+
+  if (sectors == 0)
+    return true;
+  if (sectors > INODE_MAX_SECTORS)
+    return false;
+
+  lock_acquire (&inode->lock);
+  success = allocate_runs (&inode->data, 0, sectors - 1, inode->sector + 1,
+                           &changed);
+  if (sectors > inode->prealloc_end)
+    inode->prealloc_end = sectors;
+  if (changed)
+    cache_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  lock_release (&inode->lock);
+  return success;
+}
+
+/** Queues the sectors of INODE that hold bytes START through END,
+   exclusive, for read-ahead into the buffer cache.  Holes and
+   bytes past the end of the file are ignored. */
+void
+inode_readahead (struct inode *inode, off_t start, off_t end) 
+{
+  off_t ofs;
+
+  lock_acquire (&inode->lock);
+  if (end > inode->data.length)
+    end = inode->data.length;
+  for (ofs = ROUND_DOWN (start, BLOCK_SECTOR_SIZE); ofs < end;
+       ofs += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, ofs);
+      if (sector != 0)
+        cache_readahead (sector);
+    }
+  lock_release (&inode->lock);
+}
+
 /** Disables writes to INODE.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&inode->lock);
 }
 
 /** Re-enables writes to INODE.
@@ -332,14 +768,94 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  lock_release (&inode->lock);
+}
+
+/** Returns the number of writes that have changed INODE's data
+   since it was opened.  Callers that cache something derived from
+   the data may keep INODE open and compare this count to tell
+   whether their copy is stale. */
+unsigned
+inode_write_cnt (struct inode *inode)
+{
+  unsigned write_cnt;
+
+  lock_acquire (&inode->lock);
+  write_cnt = inode->write_cnt;
+  lock_release (&inode->lock);
+  return write_cnt;
+}
+
+/** Marks INODE as held by the executable image cache, so that the
+   next write to INODE or its removal calls process_forget_exec().
+   Fails, returning false, if INODE has been removed or written
+   since its write count was WRITE_CNT. */
+bool
+inode_mark_exec (struct inode *inode, unsigned write_cnt)
+{
+  bool success;
+
+  lock_acquire (&inode->lock);
+  success = !inode->removed && inode->write_cnt == write_cnt;
+  if (success)
+    inode->exec_cached = true;
+  lock_release (&inode->lock);
+  return success;
+}
+
+/** Returns true if INODE is a directory, false if it is an
+   ordinary file. */
+bool
+inode_is_dir (struct inode *inode)
+{
+  bool is_dir;
+
+  lock_acquire (&inode->lock);
+  is_dir = inode->data.is_dir != 0;
+  lock_release (&inode->lock);
+  return is_dir;
+}
+
+/** Returns the number of openers that INODE has. */
+int
+inode_open_cnt (struct inode *inode)
+{
+  int open_cnt;
+
+  lock_acquire (&open_inodes_lock);
+  open_cnt = inode->open_cnt;
+  lock_release (&open_inodes_lock);
+  return open_cnt;
 }
 
 /** Returns the length, in bytes, of INODE's data. */
 off_t
-inode_length (const struct inode *inode)
+inode_length (struct inode *inode)
+{
+  off_t length;
+
+  lock_acquire (&inode->lock);
+  length = inode->data.length;
+  lock_release (&inode->lock);
+  return length;
+}
+
+/** Acquires INODE's directory lock.  directory.c holds it while
+   it looks at or changes INODE's contents as a directory, so that
+   each directory operation is atomic. */
+void
+inode_lock_dir (struct inode *inode) 
+{
+  lock_acquire (&inode->dir_lock);
+}
+
+/** Releases INODE's directory lock. */
+void
+inode_unlock_dir (struct inode *inode) 
 {
-  return inode->data.length;
+  lock_release (&inode->dir_lock);
 }
@@ -0,0 +1,27 @@
+#ifndef __LIB_RUSAGE_H
+#define __LIB_RUSAGE_H
+
+/** Number of system call numbers counted individually in `struct
+   rusage'.  Calls with higher numbers are not counted. */
+#define RUSAGE_SYSCALLS 64
+
+/** Resources used by a process so far, summed over its threads
+   (see getrusage()).  Shared by the kernel and user programs.
+
+   Disk transfers count file system sectors that actually move
+   between the buffer cache and the disk, each charged to the
+   process that caused it: a read to the process that missed in
+   the cache, and a write to the process that last modified the
+   sector, even though the flusher thread or another process
+   usually writes it back later.  A sector still unwritten when
+   the process that modified it exits is not charged to anyone. */
+struct rusage
+  {
+    unsigned ticks;             /**< Timer ticks spent running. */
+    unsigned page_faults;       /**< Page faults taken. */
+    unsigned sectors_read;      /**< File system sectors read. */
+    unsigned sectors_written;   /**< File system sectors written. */
+    unsigned syscalls[RUSAGE_SYSCALLS]; /**< System calls, by number. */
+  };
+
+#endif /**< lib/rusage.h */
@@ -0,0 +1,28 @@
+#ifndef __LIB_SPAWN_H
+#define __LIB_SPAWN_H
+
+/** Kinds of file descriptor action for spawn(). */
+enum spawn_action_type
+  {
+    SPAWN_DUP,                  /**< Give the child a copy of SRC_FD as FD. */
+    SPAWN_OPEN,                 /**< Open PATH in the child as FD. */
+    SPAWN_CLOSE                 /**< Close FD in the child. */
+  };
+
+/** One file descriptor action for spawn().  The actions are
+   applied in order to the child's descriptor table, which starts
+   out with only the console open as descriptors 0 and 1, before
+   the child first runs.  Shared by the kernel and user
+   programs. */
+struct spawn_action
+  {
+    enum spawn_action_type type; /**< What to do. */
+    int fd;                     /**< Descriptor in the child. */
+    int src_fd;                 /**< SPAWN_DUP: descriptor in the parent. */
+    const char *path;           /**< SPAWN_OPEN: file to open. */
+  };
+
+/** Maximum number of actions in one spawn() call. */
+#define SPAWN_MAX_ACTIONS 16
+
+#endif /**< lib/spawn.h */
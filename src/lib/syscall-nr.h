@@ -28,7 +28,21 @@ enum
     SYS_MKDIR,                  /**< Create a directory. */
     SYS_READDIR,                /**< Reads a directory entry. */
     SYS_ISDIR,                  /**< Tests if a fd represents a directory. */
-    SYS_INUMBER                 /**< Returns the inode number for a fd. */
+    SYS_INUMBER,                /**< Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_READV,                  /**< Read from a file into several buffers. */
+    SYS_WRITEV,                 /**< Write to a file from several buffers. */
+    SYS_SPAWN,                  /**< Start a process, setting up its fds. */
+    SYS_PIPE,                   /**< Create a pipe. */
+    SYS_SHM_CREATE,             /**< Create shared memory. */
+    SYS_SHM_ATTACH,             /**< Map shared memory. */
+    SYS_FUTEX_WAIT,             /**< Sleep while a word holds a value. */
+    SYS_FUTEX_WAKE,             /**< Wake threads sleeping on a word. */
+    SYS_UTHREAD_CREATE,         /**< Start a thread in this process. */
+    SYS_UTHREAD_JOIN,           /**< Wait for a thread to exit. */
+    SYS_UTHREAD_EXIT,           /**< End the calling thread. */
+    SYS_GETRUSAGE               /**< Get resource usage. */
   };
 
 #endif /**< lib/syscall-nr.h */
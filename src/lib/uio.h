@@ -0,0 +1,17 @@
+#ifndef __LIB_UIO_H
+#define __LIB_UIO_H
+
+#include <stddef.h>
+
+/** One buffer in a vectored I/O request (see readv() and
+   writev()).  Shared by the kernel and user programs. */
+struct iovec
+  {
+    void *iov_base;             /**< Start of buffer. */
+    size_t iov_len;             /**< Length of buffer in bytes. */
+  };
+
+/** Maximum number of buffers in one vectored I/O request. */
+#define IOV_MAX 1024
+
+#endif /**< lib/uio.h */
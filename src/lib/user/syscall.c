@@ -182,3 +182,86 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+pid_t
+spawn (const char *cmd_line, const struct spawn_action *actions,
+       int action_cnt)
+{
+  return syscall3 (SYS_SPAWN, cmd_line, actions, action_cnt);
+}
+
+bool
+pipe (int fds[2])
+{
+  return syscall1 (SYS_PIPE, fds);
+}
+
+int
+shm_create (unsigned size)
+{
+  return syscall1 (SYS_SHM_CREATE, size);
+}
+
+mapid_t
+shm_attach (int fd, void *addr)
+{
+  return syscall2 (SYS_SHM_ATTACH, fd, addr);
+}
+
+int
+futex_wait (int *addr, int val)
+{
+  return syscall2 (SYS_FUTEX_WAIT, addr, val);
+}
+
+int
+futex_wake (int *addr, int cnt)
+{
+  return syscall2 (SYS_FUTEX_WAKE, addr, cnt);
+}
+
+/** Where a thread started by uthread_create() begins: runs FUNC
+   and exits with status 0 if it returns. */
+static void
+uthread_start (uthread_func *func, void *aux)
+{
+  func (aux);
+  uthread_exit (0);
+}
+
+utid_t
+uthread_create (uthread_func *func, void *aux)
+{
+  return syscall3 (SYS_UTHREAD_CREATE, uthread_start, func, aux);
+}
+
+int
+uthread_join (utid_t tid)
+{
+  return syscall1 (SYS_UTHREAD_JOIN, tid);
+}
+
+void
+uthread_exit (int status)
+{
+  syscall1 (SYS_UTHREAD_EXIT, status);
+  NOT_REACHED ();
+}
+
+void
+getrusage (struct rusage *usage)
+{
+  syscall1 (SYS_GETRUSAGE, usage);
+}
@@ -3,11 +3,21 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <rusage.h>
+#include <spawn.h>
+#include <uio.h>
 
 /** Process identifier. */
 typedef int pid_t;
 #define PID_ERROR ((pid_t) -1)
 
+/** Thread identifier. */
+typedef int utid_t;
+#define UTID_ERROR ((utid_t) -1)
+
+/** Function run by a thread started with uthread_create(). */
+typedef void uthread_func (void *aux);
+
 /** Map region identifier. */
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
@@ -45,4 +55,19 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/** Extensions. */
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+pid_t spawn (const char *cmd_line, const struct spawn_action *actions,
+             int action_cnt);
+bool pipe (int fds[2]);
+int shm_create (unsigned size);
+mapid_t shm_attach (int fd, void *addr);
+int futex_wait (int *addr, int val);
+int futex_wake (int *addr, int cnt);
+utid_t uthread_create (uthread_func *, void *aux);
+int uthread_join (utid_t);
+void uthread_exit (int status) NO_RETURN;
+void getrusage (struct rusage *);
+
 #endif /**< lib/user/syscall.h */
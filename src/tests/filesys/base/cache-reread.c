@@ -0,0 +1,64 @@
+/** Writes a file a few sectors long, then writes another file
+   twice the size of the buffer cache to push the first one out.
+   Reads the first file back twice and checks that the first read
+   goes to disk and the second, served from the cache, reads less
+   from disk than the first. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TEST_SIZE (8 * 512)
+#define FLUSH_SIZE (128 * 512)  /**< Twice the 64-sector cache. */
+static char buf[TEST_SIZE];
+
+/** Reads FD, named FILE_NAME, from its start into BUF, logging
+   the read with WHICH appended, and returns the number of sectors
+   the read took from disk. */
+static unsigned
+read_all (int fd, const char *file_name, const char *which)
+{
+  struct rusage before, after;
+
+  seek (fd, 0);
+  getrusage (&before);
+  CHECK (read (fd, buf, TEST_SIZE) == TEST_SIZE,
+         "read \"%s\"%s", file_name, which);
+  getrusage (&after);
+  return after.sectors_read - before.sectors_read;
+}
+
+void
+test_main (void) 
+{
+  const char *file_name = "cached";
+  const char *flush_name = "flush";
+  unsigned first, second;
+  int fd, flush_fd;
+  int ofs;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, TEST_SIZE), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, TEST_SIZE) == TEST_SIZE,
+         "write \"%s\"", file_name);
+
+  CHECK (create (flush_name, 0), "create \"%s\"", flush_name);
+  CHECK ((flush_fd = open (flush_name)) > 1, "open \"%s\"", flush_name);
+  for (ofs = 0; ofs < FLUSH_SIZE; ofs += TEST_SIZE)
+    if (write (flush_fd, buf, TEST_SIZE) != TEST_SIZE)
+      fail ("write \"%s\" at offset %d failed", flush_name, ofs);
+  msg ("write \"%s\"", flush_name);
+  msg ("close \"%s\"", flush_name);
+  close (flush_fd);
+
+  first = read_all (fd, file_name, "");
+  second = read_all (fd, file_name, " again");
+  CHECK (first > 0, "first read went to disk");
+  CHECK (second < first, "second read hit the cache");
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
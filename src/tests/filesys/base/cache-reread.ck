@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cache-reread) begin
+(cache-reread) create "cached"
+(cache-reread) open "cached"
+(cache-reread) write "cached"
+(cache-reread) create "flush"
+(cache-reread) open "flush"
+(cache-reread) write "flush"
+(cache-reread) close "flush"
+(cache-reread) read "cached"
+(cache-reread) read "cached" again
+(cache-reread) first read went to disk
+(cache-reread) second read hit the cache
+(cache-reread) close "cached"
+(cache-reread) end
+EOF
+pass;
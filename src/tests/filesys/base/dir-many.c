@@ -0,0 +1,60 @@
+/** Creates enough files in the root directory that it has to grow
+   several times, checks that each of them can be opened, removes
+   every other one, and checks that exactly the rest remain. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 200
+
+void
+test_main (void) 
+{
+  char name[16];
+  int fd;
+  int i;
+
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      CHECK (create (name, 0), "create \"%s\"", name);
+    }
+  quiet = false;
+  msg ("created %d files", FILE_CNT);
+
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+      close (fd);
+    }
+  quiet = false;
+  msg ("opened %d files", FILE_CNT);
+
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i += 2)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      CHECK (remove (name), "remove \"%s\"", name);
+    }
+  quiet = false;
+  msg ("removed %d files", FILE_CNT / 2);
+
+  quiet = true;
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "file%d", i);
+      fd = open (name);
+      if (i % 2 == 0)
+        CHECK (fd == -1, "open removed \"%s\"", name);
+      else
+        CHECK (fd > 1, "open \"%s\"", name);
+      close (fd);
+    }
+  quiet = false;
+  msg ("checked %d files", FILE_CNT);
+}
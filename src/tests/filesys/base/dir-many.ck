@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-many) begin
+(dir-many) created 200 files
+(dir-many) opened 200 files
+(dir-many) removed 100 files
+(dir-many) checked 200 files
+(dir-many) end
+EOF
+pass;
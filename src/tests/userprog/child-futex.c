@@ -0,0 +1,21 @@
+/** Child process run by futex-shm test.
+   Attaches the shared memory region passed as descriptor 2, sets
+   the futex word at its start and wakes the parent. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+
+const char *test_name = "child-futex";
+
+int
+main (void) 
+{
+  int *word = (int *) 0x20000000;
+
+  if (shm_attach (2, word) == MAP_FAILED)
+    fail ("shm_attach");
+  *word = 42;
+  if (futex_wake (word, 1) < 0)
+    fail ("futex_wake");
+  return 0;
+}
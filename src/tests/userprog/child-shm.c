@@ -0,0 +1,23 @@
+/** Child process run by shm-spawn test.
+   Attaches the shared memory region passed as descriptor 2,
+   checks for the parent's message and replaces it with a
+   reply. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+const char *test_name = "child-shm";
+
+int
+main (void) 
+{
+  char *buf = (char *) 0x20000000;
+
+  if (shm_attach (2, buf) == MAP_FAILED)
+    fail ("shm_attach");
+  if (strcmp (buf, "ping"))
+    fail ("shared memory holds \"%s\" instead of \"ping\"", buf);
+  strlcpy (buf, "pong", 4096);
+  return 0;
+}
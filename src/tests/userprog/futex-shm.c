@@ -0,0 +1,34 @@
+/** Sleeps on a futex in shared memory until child-futex, which
+   attaches the same memory, sets the word and wakes us up.  Also
+   checks that waiting on a word that does not hold the expected
+   value returns at once. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int *word = (int *) 0x10000000;
+  struct spawn_action action;
+  pid_t pid;
+  int fd;
+
+  CHECK ((fd = shm_create (4096)) > 1, "shm_create");
+  CHECK (shm_attach (fd, word) != MAP_FAILED, "shm_attach");
+  CHECK (futex_wait (word, 1) == -1, "futex_wait with wrong value");
+
+  action.type = SPAWN_DUP;
+  action.fd = 2;
+  action.src_fd = fd;
+  CHECK ((pid = spawn ("child-futex", &action, 1)) != PID_ERROR,
+         "spawn child-futex");
+
+  /* The child may set the word before we get to wait. */
+  while (*word == 0)
+    futex_wait (word, 0);
+  msg ("woken with %d", *word);
+
+  CHECK (wait (pid) == 0, "wait for child-futex");
+}
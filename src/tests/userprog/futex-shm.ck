@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF', <<'EOF']);
+(futex-shm) begin
+(futex-shm) shm_create
+(futex-shm) shm_attach
+(futex-shm) futex_wait with wrong value
+(futex-shm) spawn child-futex
+(futex-shm) woken with 42
+child-futex: exit(0)
+(futex-shm) wait for child-futex
+(futex-shm) end
+futex-shm: exit(0)
+EOF
+(futex-shm) begin
+(futex-shm) shm_create
+(futex-shm) shm_attach
+(futex-shm) futex_wait with wrong value
+(futex-shm) spawn child-futex
+child-futex: exit(0)
+(futex-shm) woken with 42
+(futex-shm) wait for child-futex
+(futex-shm) end
+futex-shm: exit(0)
+EOF
+pass;
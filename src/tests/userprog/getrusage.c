@@ -0,0 +1,38 @@
+/** Checks that getrusage() counts system calls by number, page
+   faults and timer ticks for the calling process. */
+
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/** Starts out mapped to the shared zero page, so the first write
+   to it faults. */
+static char zeros[4096] __attribute__ ((aligned (4096)));
+
+void
+test_main (void) 
+{
+  struct rusage before, after;
+  int handle;
+  int i;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  getrusage (&before);
+  for (i = 0; i < 3; i++)
+    tell (handle);
+  zeros[0] = 1;
+  getrusage (&after);
+
+  CHECK (after.syscalls[SYS_TELL] == before.syscalls[SYS_TELL] + 3,
+         "three tell calls counted");
+  CHECK (after.syscalls[SYS_GETRUSAGE]
+         == before.syscalls[SYS_GETRUSAGE] + 1,
+         "one getrusage call counted");
+  CHECK (after.page_faults > before.page_faults, "page fault counted");
+
+  while (after.ticks == before.ticks)
+    getrusage (&after);
+  msg ("ticks counted");
+}
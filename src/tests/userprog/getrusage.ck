@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(getrusage) begin
+(getrusage) open "sample.txt"
+(getrusage) three tell calls counted
+(getrusage) one getrusage call counted
+(getrusage) page fault counted
+(getrusage) ticks counted
+(getrusage) end
+getrusage: exit(0)
+EOF
+pass;
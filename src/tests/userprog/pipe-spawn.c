@@ -0,0 +1,42 @@
+/** Spawns child-simple with its standard output going into a
+   pipe, then reads the pipe to end of file, which comes only once
+   the child exits, and verifies the child's message. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char expected[] = "(child-simple) run\n";
+
+void
+test_main (void) 
+{
+  struct spawn_action action;
+  char buf[sizeof expected];
+  size_t ofs = 0;
+  int fds[2];
+  pid_t pid;
+  int n;
+
+  CHECK (pipe (fds), "pipe");
+
+  action.type = SPAWN_DUP;
+  action.fd = STDOUT_FILENO;
+  action.src_fd = fds[1];
+  CHECK ((pid = spawn ("child-simple", &action, 1)) != PID_ERROR,
+         "spawn child-simple with output to pipe");
+  close (fds[1]);
+
+  while ((n = read (fds[0], buf + ofs, sizeof buf - ofs)) > 0)
+    ofs += n;
+  msg ("read pipe to end of file");
+  if (ofs != sizeof expected - 1)
+    fail ("read %zu bytes from pipe instead of %zu",
+          ofs, sizeof expected - 1);
+  compare_bytes (buf, expected, ofs, 0, "pipe");
+  close (fds[0]);
+
+  CHECK (wait (pid) == 81, "wait for child-simple");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe-spawn) begin
+(pipe-spawn) pipe
+(pipe-spawn) spawn child-simple with output to pipe
+child-simple: exit(81)
+(pipe-spawn) read pipe to end of file
+(pipe-spawn) wait for child-simple
+(pipe-spawn) end
+pipe-spawn: exit(0)
+EOF
+pass;
@@ -0,0 +1,46 @@
+/** Writes sample.txt's contents to a new file with writev(),
+   split across three buffers, then reads it back with readv()
+   into three differently sized buffers and verifies it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[sizeof sample];
+
+void
+test_main (void) 
+{
+  struct iovec iov[3];
+  size_t size = sizeof sample - 1;
+  int handle, byte_cnt;
+
+  CHECK (create ("test.txt", size), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  iov[0].iov_base = sample;
+  iov[0].iov_len = 10;
+  iov[1].iov_base = sample + 10;
+  iov[1].iov_len = size / 2;
+  iov[2].iov_base = sample + 10 + size / 2;
+  iov[2].iov_len = size - 10 - size / 2;
+  byte_cnt = writev (handle, iov, 3);
+  if (byte_cnt != (int) size)
+    fail ("writev() returned %d instead of %zu", byte_cnt, size);
+
+  seek (handle, 0);
+  iov[0].iov_base = buf;
+  iov[0].iov_len = size / 3;
+  iov[1].iov_base = buf + size / 3;
+  iov[1].iov_len = 1;
+  iov[2].iov_base = buf + size / 3 + 1;
+  iov[2].iov_len = size - size / 3 - 1;
+  byte_cnt = readv (handle, iov, 3);
+  if (byte_cnt != (int) size)
+    fail ("readv() returned %d instead of %zu", byte_cnt, size);
+  compare_bytes (buf, sample, size, 0, "test.txt");
+  msg ("close \"test.txt\"");
+  close (handle);
+}
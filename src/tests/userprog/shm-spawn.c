@@ -0,0 +1,30 @@
+/** Creates a shared memory region, writes to it, and spawns
+   child-shm with the region as descriptor 2.  The child attaches
+   the region at a different address, checks what the parent wrote
+   and writes a reply, which the parent then sees in its own
+   mapping. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char *buf = (char *) 0x10000000;
+  struct spawn_action action;
+  int fd;
+
+  CHECK ((fd = shm_create (4096)) > 1, "shm_create");
+  CHECK (shm_attach (fd, buf) != MAP_FAILED, "shm_attach");
+  strlcpy (buf, "ping", 4096);
+
+  action.type = SPAWN_DUP;
+  action.fd = 2;
+  action.src_fd = fd;
+  CHECK (wait (spawn ("child-shm", &action, 1)) == 0, "run child-shm");
+  if (strcmp (buf, "pong"))
+    fail ("shared memory holds \"%s\" instead of \"pong\"", buf);
+  msg ("read reply");
+}
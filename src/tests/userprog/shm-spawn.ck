@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(shm-spawn) begin
+(shm-spawn) shm_create
+(shm-spawn) shm_attach
+(shm-spawn) run child-shm
+child-shm: exit(0)
+(shm-spawn) read reply
+(shm-spawn) end
+shm-spawn: exit(0)
+EOF
+pass;
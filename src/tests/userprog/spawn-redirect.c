@@ -0,0 +1,35 @@
+/** Spawns child-simple with its standard output opened to a file
+   and verifies that the child's message went to the file instead
+   of the console. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char expected[] = "(child-simple) run\n";
+
+void
+test_main (void) 
+{
+  struct spawn_action action;
+  char buf[sizeof expected - 1];
+  int handle, byte_cnt;
+
+  CHECK (create ("out.txt", sizeof buf), "create \"out.txt\"");
+
+  action.type = SPAWN_OPEN;
+  action.fd = STDOUT_FILENO;
+  action.path = "out.txt";
+  CHECK (wait (spawn ("child-simple", &action, 1)) == 81,
+         "spawn child-simple with output to \"out.txt\"");
+
+  CHECK ((handle = open ("out.txt")) > 1, "open \"out.txt\"");
+  byte_cnt = read (handle, buf, sizeof buf);
+  if (byte_cnt != (int) sizeof buf)
+    fail ("read() returned %d instead of %zu", byte_cnt, sizeof buf);
+  compare_bytes (buf, expected, sizeof buf, 0, "out.txt");
+  msg ("close \"out.txt\"");
+  close (handle);
+}
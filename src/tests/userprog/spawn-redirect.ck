@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(spawn-redirect) begin
+(spawn-redirect) create "out.txt"
+(spawn-redirect) spawn child-simple with output to "out.txt"
+child-simple: exit(81)
+(spawn-redirect) open "out.txt"
+(spawn-redirect) close "out.txt"
+(spawn-redirect) end
+spawn-redirect: exit(0)
+EOF
+pass;
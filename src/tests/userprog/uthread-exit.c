@@ -0,0 +1,78 @@
+/** Starts threads that block reading a pipe whose write end the
+   process itself holds, reading the console, and joining the first
+   of them, then calls exit() from the main thread.  None of the
+   waits can ever complete on its own, so the process must still
+   end, with the main thread's exit status. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int pipe_fds[2];
+static int ready_fds[2];
+static utid_t reader_tid;
+
+/** Tells the main thread that the calling thread is about to
+   block. */
+static void
+ready (void)
+{
+  char c = 'r';
+  write (ready_fds[1], &c, 1);
+}
+
+static void
+pipe_reader (void *aux UNUSED)
+{
+  char c;
+
+  ready ();
+  read (pipe_fds[0], &c, 1);
+  fail ("read from pipe returned");
+}
+
+static void
+console_reader (void *aux UNUSED)
+{
+  char c;
+
+  ready ();
+  read (STDIN_FILENO, &c, 1);
+  fail ("read from console returned");
+}
+
+static void
+joiner (void *aux UNUSED)
+{
+  ready ();
+  uthread_join (reader_tid);
+  fail ("join returned");
+}
+
+void
+test_main (void) 
+{
+  char buf[3];
+  int n;
+
+  CHECK (pipe (pipe_fds), "pipe");
+  CHECK (pipe (ready_fds), "pipe");
+  CHECK ((reader_tid = uthread_create (pipe_reader, NULL)) != UTID_ERROR,
+         "uthread_create pipe reader");
+  CHECK (uthread_create (console_reader, NULL) != UTID_ERROR,
+         "uthread_create console reader");
+  CHECK (uthread_create (joiner, NULL) != UTID_ERROR,
+         "uthread_create joiner");
+
+  /* Each thread blocks right after it reports in. */
+  for (n = 0; n < 3; )
+    {
+      int retval = read (ready_fds[0], buf + n, 3 - n);
+      if (retval <= 0)
+        fail ("read from pipe returned %d", retval);
+      n += retval;
+    }
+  msg ("threads blocked");
+  exit (57);
+}
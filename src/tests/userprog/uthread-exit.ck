@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(uthread-exit) begin
+(uthread-exit) pipe
+(uthread-exit) pipe
+(uthread-exit) uthread_create pipe reader
+(uthread-exit) uthread_create console reader
+(uthread-exit) uthread_create joiner
+(uthread-exit) threads blocked
+uthread-exit: exit(57)
+EOF
+pass;
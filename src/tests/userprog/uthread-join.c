@@ -0,0 +1,68 @@
+/** Starts several threads that fill in parts of a shared array
+   and write to a pipe the main thread opened, then joins them and
+   checks their exit statuses and results.  Joining a thread twice
+   must fail. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+#define CHUNK 256
+
+static int numbers[THREAD_CNT * CHUNK];
+static int sums[THREAD_CNT];
+static int pipe_fds[2];
+
+/** Sums chunk *AUX of NUMBERS into SUMS, reports its number
+   through the pipe and exits with status chunk + 1. */
+static void
+summer (void *aux)
+{
+  int chunk = *(int *) aux;
+  char c = 'a' + chunk;
+  int i;
+
+  for (i = 0; i < CHUNK; i++)
+    sums[chunk] += numbers[chunk * CHUNK + i];
+  write (pipe_fds[1], &c, 1);
+  uthread_exit (chunk + 1);
+}
+
+void
+test_main (void) 
+{
+  int chunks[THREAD_CNT];
+  utid_t tids[THREAD_CNT];
+  char seen[THREAD_CNT];
+  int i, n;
+
+  for (i = 0; i < THREAD_CNT * CHUNK; i++)
+    numbers[i] = i;
+  CHECK (pipe (pipe_fds), "pipe");
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      chunks[i] = i;
+      CHECK ((tids[i] = uthread_create (summer, &chunks[i])) != UTID_ERROR,
+             "uthread_create %d", i);
+    }
+
+  for (n = 0; n < THREAD_CNT; )
+    {
+      int retval = read (pipe_fds[0], seen + n, THREAD_CNT - n);
+      if (retval <= 0)
+        fail ("read from pipe returned %d", retval);
+      n += retval;
+    }
+  msg ("read from pipe");
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      int expected = (CHUNK * i + CHUNK * (i + 1) - 1) * CHUNK / 2;
+
+      CHECK (uthread_join (tids[i]) == i + 1, "join thread %d", i);
+      if (sums[i] != expected)
+        fail ("sum %d is %d, expected %d", i, sums[i], expected);
+    }
+  CHECK (uthread_join (tids[0]) == -1, "join thread 0 again");
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(uthread-join) begin
+(uthread-join) pipe
+(uthread-join) uthread_create 0
+(uthread-join) uthread_create 1
+(uthread-join) uthread_create 2
+(uthread-join) uthread_create 3
+(uthread-join) read from pipe
+(uthread-join) join thread 0
+(uthread-join) join thread 1
+(uthread-join) join thread 2
+(uthread-join) join thread 3
+(uthread-join) join thread 0 again
+(uthread-join) end
+uthread-join: exit(0)
+EOF
+pass;
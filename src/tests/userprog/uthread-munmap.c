@@ -0,0 +1,62 @@
+/** Has one thread read from an empty pipe into a mapped file
+   while another thread unmaps the file, then fills the pipe.  The
+   read must complete into the page's old frame without corrupting
+   kernel memory, and the file must keep its original contents. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+
+static int pipe_fds[2];
+static int ready_fds[2];
+
+/** Tells the main thread it is about to read, then reads a
+   buffer's worth from the pipe into the mapping and exits with the
+   number of bytes read. */
+static void
+reader (void *aux UNUSED)
+{
+  char c = 'r';
+
+  write (ready_fds[1], &c, 1);
+  uthread_exit (read (pipe_fds[0], ACTUAL, sizeof sample));
+}
+
+void
+test_main (void) 
+{
+  char buf[sizeof sample];
+  utid_t tid;
+  mapid_t map;
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  CHECK (pipe (pipe_fds), "pipe");
+  CHECK (pipe (ready_fds), "pipe");
+  CHECK ((tid = uthread_create (reader, NULL)) != UTID_ERROR,
+         "uthread_create");
+
+  /* Wait for the reader to report in.  We block until it does, so
+     it runs from then on in a time slice of its own, which is far
+     longer than it needs to go on into read() and block there. */
+  CHECK (read (ready_fds[0], buf, 1) == 1, "reader ready");
+
+  munmap (map);
+  msg ("munmap \"sample.txt\"");
+
+  memset (buf, 'x', sizeof buf);
+  CHECK (write (pipe_fds[1], buf, sizeof buf) == sizeof buf,
+         "write to pipe");
+  CHECK (uthread_join (tid) == sizeof sample, "join reader");
+
+  CHECK (read (handle, buf, sizeof buf) == sizeof sample - 1,
+         "read \"sample.txt\"");
+  if (memcmp (buf, sample, sizeof sample - 1))
+    fail ("\"sample.txt\" was changed");
+  msg ("\"sample.txt\" unchanged");
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(uthread-munmap) begin
+(uthread-munmap) open "sample.txt"
+(uthread-munmap) mmap "sample.txt"
+(uthread-munmap) pipe
+(uthread-munmap) pipe
+(uthread-munmap) uthread_create
+(uthread-munmap) reader ready
+(uthread-munmap) munmap "sample.txt"
+(uthread-munmap) write to pipe
+(uthread-munmap) join reader
+(uthread-munmap) read "sample.txt"
+(uthread-munmap) "sample.txt" unchanged
+(uthread-munmap) end
+uthread-munmap: exit(0)
+EOF
+pass;
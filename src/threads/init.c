@@ -58,6 +58,7 @@ static const char *swap_bdev_name;
 static size_t user_page_limit = SIZE_MAX;
 
 static void bss_init (void);
+static bool cpu_has_pse (void);
 static void paging_init (void);
 
 static char **read_command_line (void);
@@ -154,17 +155,51 @@ bss_init (void)
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
-/** Populates the base page directory and page table with the
+/** CPUID feature flag (leaf 1, EDX) for page size extensions. */
+#define CPUID_PSE 0x00000008
+
+/** Flag in control register 4 that enables 4 MB pages. */
+#define CR4_PSE 0x00000010
+
+/** Returns true if the CPU supports 4 MB pages. */
+static bool
+cpu_has_pse (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  /* See [IA32-v2a] "CPUID--CPU Identification". */
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return (edx & CPUID_PSE) != 0;
+}
+
+/** Populates the base page directory and page tables with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports it, each 4 MB region of RAM that lies
+   entirely within physical memory and holds no kernel text is
+   mapped by a single large-page PDE instead of a page table.
+   That saves a page table per region and, more importantly, lets
+   one TLB entry cover what would otherwise take 1024.  The region
+   holding the kernel text keeps 4 kB pages so that the text can
+   stay read-only. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
+  bool use_pse = cpu_has_pse ();
   extern char _start, _end_kernel_text;
 
+  if (use_pse)
+    {
+      uint32_t cr4;
+
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PSE));
+    }
+
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
   for (page = 0; page < init_ram_pages; page++)
@@ -175,6 +210,15 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (use_pse && pte_idx == 0
+          && page + LGPGSIZE / PGSIZE <= init_ram_pages
+          && !(&_start < vaddr + LGPGSIZE && vaddr < &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_large (vaddr, true);
+          page += LGPGSIZE / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -263,6 +307,8 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-rusage"))
+        process_print_rusage = true;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -385,6 +431,7 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -rusage            Print resources used by each process.\n"
 #endif
           );
   shutdown_power_off ();
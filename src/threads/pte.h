@@ -66,6 +66,11 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_U 0x4               /**< 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20              /**< 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /**< 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80             /**< 1=4 MB page, 0=page table (PDEs only). */
+
+/** Bytes covered by a large (4 MB) page: a whole page table's
+   worth of memory, mapped by a single PDE. */
+#define LGPGSIZE PTSPAN
 
 /** Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -73,10 +78,21 @@ static inline uint32_t pde_create (uint32_t *pt) {
   return vtop (pt) | PTE_U | PTE_P | PTE_W;
 }
 
+/** Returns a PDE that maps the 4 MB region starting at PAGE
+   directly, without a page table, as a kernel-only large page.
+   If WRITABLE is true then it will be writable as well.
+   Requires CR4.PSE to be set; see [IA32-v3a] 3.7.3 "Mixing 4-KByte
+   and 4-MByte Pages". */
+static inline uint32_t pde_create_large (void *page, bool writable) {
+  ASSERT (((uintptr_t) page & (LGPGSIZE - 1)) == 0);
+  return vtop (page) | PTE_PS | PTE_P | (writable ? PTE_W : 0);
+}
+
 /** Returns a pointer to the page table that page directory entry
-   PDE, which must "present", points to. */
+   PDE, which must "present" and not be a large page, points to. */
 static inline uint32_t *pde_get_pt (uint32_t pde) {
   ASSERT (pde & PTE_P);
+  ASSERT (!(pde & PTE_PS));
   return ptov (pde & PTE_ADDR);
 }
 
@@ -75,6 +75,37 @@ sema_down (struct semaphore *sema)
   intr_set_level (old_level);
 }
 
+/** Down or "P" operation on a semaphore, like sema_down(), except
+   that it gives up and returns false, leaving the semaphore as it
+   was, if the current thread is interrupted first; see
+   thread_interrupt().  Returns true if the semaphore is
+   decremented. */
+bool
+sema_down_interruptible (struct semaphore *sema) 
+{
+  enum intr_level old_level;
+  bool success = true;
+
+  ASSERT (sema != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  while (sema->value == 0) 
+    {
+      if (thread_interrupted ())
+        {
+          success = false;
+          break;
+        }
+      list_push_back (&sema->waiters, &thread_current ()->elem);
+      thread_block_interruptible (NULL);
+    }
+  if (success)
+    sema->value--;
+  intr_set_level (old_level);
+  return success;
+}
+
 /** Down or "P" operation on a semaphore, but only if the
    semaphore is not already 0.  Returns true if the semaphore is
    decremented, false otherwise.
@@ -200,6 +231,22 @@ lock_acquire (struct lock *lock)
   lock->holder = thread_current ();
 }
 
+/** Acquires LOCK like lock_acquire(), except that it gives up and
+   returns false if the current thread is interrupted first; see
+   thread_interrupt().  Returns true if the lock is acquired. */
+bool
+lock_acquire_interruptible (struct lock *lock)
+{
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!lock_held_by_current_thread (lock));
+
+  if (!sema_down_interruptible (&lock->semaphore))
+    return false;
+  lock->holder = thread_current ();
+  return true;
+}
+
 /** Tries to acquires LOCK and returns true if successful or false
    on failure.  The lock must not already be held by the current
    thread.
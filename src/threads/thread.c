@@ -12,8 +12,12 @@
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 #ifdef USERPROG
+#include <rusage.h>
 #include "userprog/process.h"
 #endif
+#ifdef FILESYS
+#include "filesys/cache.h"
+#endif
 
 /** Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
@@ -133,6 +137,13 @@ thread_tick (void)
 #endif
   else
     kernel_ticks++;
+#ifdef USERPROG
+  if (t->rusage != NULL)
+    t->rusage->ticks++;
+#endif
+#ifdef FILESYS
+  cache_tick ();
+#endif
 
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
@@ -242,6 +253,66 @@ thread_unblock (struct thread *t)
   intr_set_level (old_level);
 }
 
+/** Puts the current thread to sleep like thread_block(), but lets
+   thread_interrupt() wake it early.  If SLOT is nonnull, it is where
+   the waker finds the thread: this function stores the thread there,
+   and whoever wakes it must set it back to null.  Otherwise, the
+   thread's `elem' must be on a list of waiters, from which
+   thread_interrupt() removes it.
+
+   The caller must have checked thread_interrupted() with interrupts
+   off, and must check it again on waking, since it cannot otherwise
+   tell an interruption from a normal wakeup. */
+void
+thread_block_interruptible (struct thread **slot)
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!cur->interrupted);
+
+  cur->interruptible = true;
+  cur->wait_slot = slot;
+  if (slot != NULL)
+    *slot = cur;
+  thread_block ();
+  cur->interruptible = false;
+  cur->wait_slot = NULL;
+}
+
+/** Interrupts thread T: if it is asleep in
+   thread_block_interruptible(), wakes it, and from now on makes it
+   give up such waits instead of starting them.  T stays interrupted
+   until it exits, so this is only useful on a thread that is meant
+   to exit, such as one whose process is exiting. */
+void
+thread_interrupt (struct thread *t)
+{
+  enum intr_level old_level;
+
+  ASSERT (is_thread (t));
+
+  old_level = intr_disable ();
+  t->interrupted = true;
+  if (t->status == THREAD_BLOCKED && t->interruptible)
+    {
+      if (t->wait_slot != NULL)
+        *t->wait_slot = NULL;
+      else
+        list_remove (&t->elem);
+      thread_unblock (t);
+    }
+  intr_set_level (old_level);
+}
+
+/** Returns true if the running thread has been interrupted, false
+   otherwise.  See thread_interrupt(). */
+bool
+thread_interrupted (void)
+{
+  return thread_current ()->interrupted;
+}
+
 /** Returns the name of the running thread. */
 const char *
 thread_name (void) 
@@ -396,6 +467,9 @@ idle (void *idle_started_ UNUSED)
     {
       /* Let someone else run. */
       intr_disable ();
+#ifdef FILESYS
+      cache_idle ();
+#endif
       thread_block ();
 
       /* Re-enable interrupts and wait for the next one.
@@ -463,6 +537,9 @@ init_thread (struct thread *t, const char *name, int priority)
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
   t->magic = THREAD_MAGIC;
+#ifdef USERPROG
+  list_init (&t->children);
+#endif
 
   old_level = intr_disable ();
   list_push_back (&all_list, &t->allelem);
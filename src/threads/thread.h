@@ -92,10 +92,17 @@ struct thread
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /**< List element. */
+    bool interrupted;                   /**< Set by thread_interrupt(). */
+    bool interruptible;                 /**< In an interruptible wait? */
+    struct thread **wait_slot;          /**< Slot naming it there, if any. */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
-    uint32_t *pagedir;                  /**< Page directory. */
+    uint32_t *pagedir;                  /**< Process's page directory. */
+    struct process *process;            /**< Process, shared w/its threads. */
+    struct uthread *uthread;            /**< Own join record, if any. */
+    struct list children;               /**< Children's status records. */
+    struct rusage *rusage;              /**< Process's resource usage. */
 #endif
 
     /* Owned by thread.c. */
@@ -117,7 +124,10 @@ typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
 
 void thread_block (void);
+void thread_block_interruptible (struct thread **slot);
 void thread_unblock (struct thread *);
+void thread_interrupt (struct thread *);
+bool thread_interrupted (void);
 
 struct thread *thread_current (void);
 tid_t thread_tid (void);
@@ -1,9 +1,13 @@
 #include "userprog/exception.h"
 #include <inttypes.h>
+#include <rusage.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /** Number of page faults processed. */
 static long long page_fault_cnt;
@@ -85,11 +89,11 @@ kill (struct intr_frame *f)
     {
     case SEL_UCSEG:
       /* User's code segment, so it's a user exception, as we
-         expected.  Kill the user process.  */
+         expected.  Kill the user process, all of its threads.  */
       printf ("%s: dying due to interrupt %#04x (%s).\n",
               thread_name (), f->vec_no, intr_name (f->vec_no));
       intr_dump_frame (f);
-      thread_exit (); 
+      process_kill (); 
 
     case SEL_KCSEG:
       /* Kernel's code segment, which indicates a kernel bug.
@@ -142,12 +146,32 @@ page_fault (struct intr_frame *f)
 
   /* Count page faults. */
   page_fault_cnt++;
+  if (thread_current ()->rusage != NULL)
+    thread_current ()->rusage->page_faults++;
 
   /* Determine cause. */
   not_present = (f->error_code & PF_P) == 0;
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+  /* A write to a page still backed by the shared zero page gets
+     its own frame, then the faulting instruction is restarted. */
+  if (!not_present && write && is_user_vaddr (fault_addr)
+      && thread_current ()->pagedir != NULL
+      && pagedir_unshare_zero_page (thread_current ()->pagedir,
+                                    pg_round_down (fault_addr)))
+    return;
+
+  /* A fault in the kernel on a user address comes from get_user()
+     or put_user() in syscall.c, which left the address to resume
+     at in %eax.  Resume there with %eax = -1 to report failure. */
+  if (!user && is_user_vaddr (fault_addr))
+    {
+      f->eip = (void (*) (void)) f->eax;
+      f->eax = 0xffffffff;
+      return;
+    }
+
   /* To implement virtual memory, delete the rest of the function
      body, and replace it with code that brings in the page to
      which fault_addr refers. */
@@ -0,0 +1,232 @@
+#include "userprog/futex.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include "userprog/process.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/** Futexes.
+
+   A futex is just an aligned 32-bit word in user memory.  User
+   code manipulates it with atomic instructions and only calls
+   futex_wait() to sleep while it holds an expected value, and
+   futex_wake() to wake sleepers after changing it, so an
+   uncontended lock or semaphore never enters the kernel.
+
+   Sleepers are kept in a hash table of wait queues, keyed by the
+   kernel virtual address of the word, that is, by the frame that
+   holds it.  Unlike the user address, this is the same in every
+   process that has the frame mapped, so futexes work across
+   processes through shared memory.  futex_lock makes checking the
+   word and going to sleep atomic with respect to wakers. */
+
+/** Threads waiting on one futex. */
+struct futex_queue
+  {
+    struct hash_elem elem;      /**< Element in `futex_table'. */
+    const int32_t *key;         /**< Kernel address of the word. */
+    struct list waiters;        /**< List of `struct futex_waiter'. */
+  };
+
+/** A thread waiting on a futex. */
+struct futex_waiter
+  {
+    struct list_elem elem;      /**< Element in queue's `waiters'. */
+    struct semaphore sema;      /**< Upped to wake the thread. */
+    const struct process *process;      /**< Thread's process. */
+  };
+
+static struct hash futex_table;
+static struct lock futex_lock;
+
+static hash_hash_func futex_hash;
+static hash_less_func futex_less;
+
+/** Initializes the futex wait table. */
+void
+futex_init (void)
+{
+  if (!hash_init (&futex_table, futex_hash, futex_less, NULL))
+    PANIC ("futex_init: out of memory");
+  lock_init (&futex_lock);
+}
+
+static unsigned
+futex_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct futex_queue *q = hash_entry (e, struct futex_queue, elem);
+  return hash_bytes (&q->key, sizeof q->key);
+}
+
+static bool
+futex_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct futex_queue *a = hash_entry (a_, struct futex_queue, elem);
+  const struct futex_queue *b = hash_entry (b_, struct futex_queue, elem);
+  return a->key < b->key;
+}
+
+/** Returns the kernel address of the futex word at user address
+   UADDR in the current process, or a null pointer if UADDR is
+   misaligned or not mapped writable, and stores the word's value
+   into *VALP if VALP is nonnull.  A page still sharing the zero
+   page gets a frame of its own first, so that the word's key does
+   not change when it is first written. */
+static const int32_t *
+futex_key (int32_t *uaddr, int32_t *valp)
+{
+  if ((uintptr_t) uaddr % sizeof *uaddr != 0)
+    return NULL;
+  return process_get_word (uaddr, valp);
+}
+
+/** Returns the wait queue for KEY, or a null pointer if there is
+   none.  Must be called with futex_lock held. */
+static struct futex_queue *
+find_queue (const int32_t *key)
+{
+  struct futex_queue q;
+  struct hash_elem *e;
+
+  q.key = key;
+  e = hash_find (&futex_table, &q.elem);
+  return e != NULL ? hash_entry (e, struct futex_queue, elem) : NULL;
+}
+
+/** If the word at user address UADDR holds VAL, sleeps until
+   futex_wake() is called for it and returns 0.  Otherwise returns
+   -1 at once, as it does if UADDR is not a valid futex, memory is
+   short, or the process is exiting. */
+int
+futex_wait (int32_t *uaddr, int32_t val)
+{
+  const int32_t *key;
+  int32_t cur_val;
+  struct futex_queue *q;
+  struct futex_waiter w;
+
+  /* process_exit_all() interrupts us before futex_wake_process()
+     takes futex_lock, so either we see that here or it finds us in
+     the table. */
+  lock_acquire (&futex_lock);
+  if (thread_interrupted ())
+    {
+      lock_release (&futex_lock);
+      return -1;
+    }
+  key = futex_key (uaddr, &cur_val);
+  if (key == NULL || cur_val != val)
+    {
+      lock_release (&futex_lock);
+      return -1;
+    }
+
+  q = find_queue (key);
+  if (q == NULL)
+    {
+      q = malloc (sizeof *q);
+      if (q == NULL)
+        {
+          lock_release (&futex_lock);
+          return -1;
+        }
+      q->key = key;
+      list_init (&q->waiters);
+      hash_insert (&futex_table, &q->elem);
+    }
+  sema_init (&w.sema, 0);
+  w.process = thread_current ()->process;
+  list_push_back (&q->waiters, &w.elem);
+  lock_release (&futex_lock);
+
+  sema_down (&w.sema);
+  return 0;
+}
+
+/** Removes Q from the wait table and frees it if no thread is
+   waiting in it.  Returns true if Q was freed.  Must be called with
+   futex_lock held. */
+static bool
+drop_queue_if_empty (struct futex_queue *q)
+{
+  if (!list_empty (&q->waiters))
+    return false;
+  hash_delete (&futex_table, &q->elem);
+  free (q);
+  return true;
+}
+
+/** Wakes up to CNT threads waiting on the futex at user address
+   UADDR, in the order they started waiting, and returns the
+   number woken, or -1 if UADDR is not a valid futex. */
+int
+futex_wake (int32_t *uaddr, int cnt)
+{
+  const int32_t *key;
+  struct futex_queue *q;
+  int woken = 0;
+
+  lock_acquire (&futex_lock);
+  key = futex_key (uaddr, NULL);
+  if (key == NULL)
+    {
+      lock_release (&futex_lock);
+      return -1;
+    }
+
+  q = find_queue (key);
+  if (q != NULL)
+    {
+      while (woken < cnt && !list_empty (&q->waiters))
+        {
+          struct list_elem *e = list_pop_front (&q->waiters);
+          sema_up (&list_entry (e, struct futex_waiter, elem)->sema);
+          woken++;
+        }
+      drop_queue_if_empty (q);
+    }
+  lock_release (&futex_lock);
+  return woken;
+}
+
+/** Wakes every thread of process PROC that is waiting on any
+   futex, so that it notices that the process is exiting.  Each
+   returns from futex_wait() as if woken normally.  This scans the
+   whole wait table, which is fine for something that happens once
+   per process. */
+void
+futex_wake_process (const struct process *proc)
+{
+  struct hash_iterator i;
+
+  lock_acquire (&futex_lock);
+ restart:
+  hash_first (&i, &futex_table);
+  while (hash_next (&i))
+    {
+      struct futex_queue *q = hash_entry (hash_cur (&i),
+                                          struct futex_queue, elem);
+      struct list_elem *e, *next;
+
+      for (e = list_begin (&q->waiters); e != list_end (&q->waiters);
+           e = next)
+        {
+          struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+
+          next = list_next (e);
+          if (w->process == proc)
+            {
+              list_remove (e);
+              sema_up (&w->sema);
+            }
+        }
+
+      /* Deleting invalidates the iterator, so start over. */
+      if (drop_queue_if_empty (q))
+        goto restart;
+    }
+  lock_release (&futex_lock);
+}
@@ -0,0 +1,13 @@
+#ifndef USERPROG_FUTEX_H
+#define USERPROG_FUTEX_H
+
+#include <stdint.h>
+
+struct process;
+
+void futex_init (void);
+int futex_wait (int32_t *uaddr, int32_t val);
+int futex_wake (int32_t *uaddr, int cnt);
+void futex_wake_process (const struct process *);
+
+#endif /**< userprog/futex.h */
@@ -3,11 +3,28 @@
 #include <stddef.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
 
+/** PTE_AVL bits used by this module. */
+#define PTE_ZERO   0x200        /**< 1=maps the shared zero page. */
+#define PTE_ZERO_W 0x400        /**< 1=zero page may be unshared on write. */
+
+/** Single read-only frame of zeros, shared by every user page
+   that has not yet been written (see pagedir_set_zero_page()). */
+static uint8_t zero_page[PGSIZE] __attribute__ ((aligned (PGSIZE)));
+
 static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
+
+/** Returns true if PTE maps the zero page and may be unshared. */
+static inline bool
+is_zero_w (uint32_t pte)
+{
+  return ((pte & (PTE_P | PTE_ZERO | PTE_ZERO_W))
+          == (PTE_P | PTE_ZERO | PTE_ZERO_W));
+}
 
 /** Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -40,7 +57,7 @@ pagedir_destroy (uint32_t *pd)
         uint32_t *pte;
         
         for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
-          if (*pte & PTE_P) 
+          if ((*pte & PTE_P) && !(*pte & PTE_ZERO))
             palloc_free_page (pte_get_page (*pte));
         palloc_free_page (pt);
       }
@@ -118,10 +135,84 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
     return false;
 }
 
+/** Maps user virtual page UPAGE in page directory PD to the
+   shared zero page, read-only.  No frame is allocated: if
+   WRITABLE is true, the first write to UPAGE faults and
+   pagedir_unshare_zero_page() then gives it a private frame.
+   UPAGE must not already be mapped.
+   Returns true if successful, false if memory allocation
+   failed. */
+bool
+pagedir_set_zero_page (uint32_t *pd, void *upage, bool writable)
+{
+  uint32_t *pte;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (pd != init_page_dir);
+
+  pte = lookup_page (pd, upage, true);
+
+  if (pte != NULL) 
+    {
+      ASSERT ((*pte & PTE_P) == 0);
+      *pte = (pte_create_user (zero_page, false) | PTE_ZERO
+              | (writable ? PTE_ZERO_W : 0));
+      return true;
+    }
+  else
+    return false;
+}
+
+/** If user virtual page UPAGE in PD is a writable mapping of the
+   shared zero page, replaces it by a freshly zeroed private frame
+   and returns true.  Returns false if UPAGE does not map the zero
+   page, if the mapping is read-only, or if no frame is available.
+
+   Several threads sharing PD may fault on UPAGE at once.  Getting
+   a frame can sleep, so the entry is checked again afterward with
+   interrupts off, and only one of them installs its frame; the
+   others return true too, since the page is now writable. */
+bool
+pagedir_unshare_zero_page (uint32_t *pd, void *upage)
+{
+  enum intr_level old_level;
+  uint32_t *pte;
+  void *kpage;
+  bool installed;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  pte = lookup_page (pd, upage, false);
+  if (pte == NULL || !is_zero_w (*pte))
+    return false;
+
+  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+  if (kpage == NULL)
+    return false;
+
+  old_level = intr_disable ();
+  installed = is_zero_w (*pte);
+  if (installed)
+    {
+      *pte = pte_create_user (kpage, true);
+      invalidate_page (pd, upage);
+    }
+  intr_set_level (old_level);
+
+  if (!installed)
+    palloc_free_page (kpage);
+  return (*pte & (PTE_P | PTE_W)) == (PTE_P | PTE_W);
+}
+
 /** Looks up the physical address that corresponds to user virtual
    address UADDR in PD.  Returns the kernel virtual address
    corresponding to that physical address, or a null pointer if
-   UADDR is unmapped. */
+   UADDR is unmapped.
+
+   A page mapped with pagedir_set_zero_page() resolves to the
+   shared zero page, which the caller must not write through. */
 void *
 pagedir_get_page (uint32_t *pd, const void *uaddr) 
 {
@@ -136,6 +227,32 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
     return NULL;
 }
 
+/** Returns the kernel virtual address that user virtual address
+   UADDR in PD maps to, for the kernel to access directly on the
+   user's behalf.  If WRITE is true, the page must be writable by
+   the user: a writable page still mapped to the shared zero page
+   is first given a private frame, and the page is marked dirty
+   because writes through the kernel mapping will not set the
+   dirty bit themselves.  Returns a null pointer if UADDR is
+   unmapped or, if WRITE is true, read-only. */
+void *
+pagedir_get_user_page (uint32_t *pd, const void *uaddr, bool write)
+{
+  uint32_t *pte;
+
+  ASSERT (is_user_vaddr (uaddr));
+
+  if (write)
+    pagedir_unshare_zero_page (pd, pg_round_down (uaddr));
+
+  pte = lookup_page (pd, uaddr, false);
+  if (pte == NULL || (*pte & PTE_P) == 0 || (write && (*pte & PTE_W) == 0))
+    return NULL;
+
+  *pte |= PTE_A | (write ? PTE_D : 0);
+  return pte_get_page (*pte) + pg_ofs (uaddr);
+}
+
 /** Marks user virtual page UPAGE "not present" in page
    directory PD.  Later accesses to the page will fault.  Other
    bits in the page table entry are preserved.
@@ -152,10 +269,19 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
+/** Returns true if virtual page VPAGE in PD is mapped and the
+   user may write to it, false otherwise. */
+bool
+pagedir_is_writable (uint32_t *pd, const void *vpage) 
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  return pte != NULL && (*pte & (PTE_P | PTE_W)) == (PTE_P | PTE_W);
+}
+
 /** Returns true if the PTE for virtual page VPAGE in PD is dirty,
    that is, if the page has been modified since the PTE was
    installed.
@@ -180,7 +306,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -209,13 +335,14 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
 /** Loads page directory PD into the CPU's page directory base
-   register. */
+   register, unless it is already loaded.  Reloading CR3 flushes
+   every non-global TLB entry, so doing it needlessly is costly. */
 void
 pagedir_activate (uint32_t *pd) 
 {
@@ -227,7 +354,8 @@ pagedir_activate (uint32_t *pd)
      new page tables immediately.  See [IA32-v2a] "MOV--Move
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base
      Address of the Page Directory". */
-  asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
+  if (active_pd () != pd)
+    asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
 }
 
 /** Returns the currently active page directory. */
@@ -243,21 +371,21 @@ active_pd (void)
   return ptov (pd);
 }
 
-/** Seom page table changes can cause the CPU's translation
+/** Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the stale
+   entry.
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   This function invalidates the TLB entry for virtual page VPAGE
+   if PD is the active page directory.  (If PD is not active then
+   its entries are not in the TLB, so there is no need to
+   invalidate anything.)  Only the one entry is dropped, with
+   INVLPG, rather than flushing the whole TLB by reloading CR3.
+   See [IA32-v2a] "INVLPG--Invalidate TLB Entry" and [IA32-v3a]
+   3.12 "Translation Lookaside Buffers (TLBs)". */
 static void
-invalidate_pagedir (uint32_t *pd) 
+invalidate_page (uint32_t *pd, const void *vpage) 
 {
   if (active_pd () == pd) 
-    {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
-    } 
+    asm volatile ("invlpg (%0)" : : "r" (vpage) : "memory");
 }
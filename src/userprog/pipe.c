@@ -0,0 +1,277 @@
+#include "userprog/pipe.h"
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/** Pipes.
+
+   A pipe is a one-page ring buffer.  HEAD counts every byte ever
+   written and TAIL every byte ever read, so HEAD - TAIL bytes are
+   buffered, even after the counters wrap around.  Only the writer
+   advances HEAD and only the reader advances TAIL, so a single
+   reader and a single writer need no lock to share the ring: each
+   publishes its progress with one store after moving the data.
+
+   Each end may be held by several descriptors, e.g. after
+   spawn() has duplicated it into a child, or used through one
+   descriptor by several threads of a process.  Once either has
+   happened the end's users take turns under its lock.  Only a
+   thread that holds a descriptor for an end can duplicate it, and
+   a process gets its second thread from its only one, so no
+   transfer at the end can be under way when it switches to
+   locking.
+
+   A reader with nothing to read, or a writer with no room, blocks
+   with interrupts off after rechecking the ring, and is unblocked
+   by the other end after it moves the counters or closes.  Since
+   at most one thread at a time transfers at each end, at most one
+   thread waits on each end.
+
+   Both kinds of wait, for the ring and for an end's lock, give up
+   if the thread is interrupted because its process is exiting, so
+   that a pipe whose other end will never move cannot keep the
+   process alive.  The transfer then stops short. */
+
+/** Bytes of data a pipe can hold. */
+#define PIPE_SIZE PGSIZE
+
+/** One end of a pipe. */
+struct pipe_end
+  {
+    int cnt;                    /**< Number of descriptors for it. */
+    bool shared;                /**< Ever had more than one? */
+    struct lock lock;           /**< Serializes transfers if shared. */
+    struct thread *waiter;      /**< Thread blocked at this end. */
+  };
+
+/** A pipe. */
+struct pipe
+  {
+    uint8_t *buf;               /**< PIPE_SIZE bytes of data. */
+    volatile uint32_t head;     /**< Bytes written; advanced by writer. */
+    volatile uint32_t tail;     /**< Bytes read; advanced by reader. */
+    struct pipe_end reader;     /**< Read end. */
+    struct pipe_end writer;     /**< Write end. */
+  };
+
+static void
+init_end (struct pipe_end *e)
+{
+  e->cnt = 1;
+  e->shared = false;
+  lock_init (&e->lock);
+  e->waiter = NULL;
+}
+
+/** Creates and returns a new, empty pipe, with one descriptor
+   for each end.  Returns a null pointer if memory is short. */
+struct pipe *
+pipe_create (void)
+{
+  struct pipe *p = malloc (sizeof *p);
+  if (p == NULL)
+    return NULL;
+
+  p->buf = palloc_get_page (0);
+  if (p->buf == NULL)
+    {
+      free (p);
+      return NULL;
+    }
+  p->head = p->tail = 0;
+  init_end (&p->reader);
+  init_end (&p->writer);
+  return p;
+}
+
+/** Returns P's read end if WRITER is false, its write end
+   otherwise. */
+static struct pipe_end *
+get_end (struct pipe *p, bool writer)
+{
+  return writer ? &p->writer : &p->reader;
+}
+
+/** Adds a descriptor for the read end of P, or its write end if
+   WRITER is true.  Must be called by a thread that holds such a
+   descriptor already. */
+void
+pipe_dup (struct pipe *p, bool writer)
+{
+  struct pipe_end *e = get_end (p, writer);
+  enum intr_level old_level = intr_disable ();
+
+  ASSERT (e->cnt > 0);
+  e->cnt++;
+  e->shared = true;
+  intr_set_level (old_level);
+}
+
+/** Makes the read end of P, or its write end if WRITER is true,
+   take turns under its lock from now on, because several threads
+   may use one descriptor for it.  No transfer at that end may be
+   under way. */
+void
+pipe_share (struct pipe *p, bool writer)
+{
+  get_end (p, writer)->shared = true;
+}
+
+/** Wakes up the thread blocked at end E, if any. */
+static void
+wake (struct pipe_end *e)
+{
+  enum intr_level old_level;
+
+  if (e->waiter == NULL)
+    return;
+
+  old_level = intr_disable ();
+  if (e->waiter != NULL)
+    {
+      thread_unblock (e->waiter);
+      e->waiter = NULL;
+    }
+  intr_set_level (old_level);
+}
+
+/** Drops a descriptor for the read end of P, or its write end if
+   WRITER is true, and frees P once neither end has any.  Closing
+   the last writer lets readers see end of file; closing the last
+   reader makes writes fail. */
+void
+pipe_close (struct pipe *p, bool writer)
+{
+  struct pipe_end *e = get_end (p, writer);
+  enum intr_level old_level = intr_disable ();
+  bool dead;
+
+  ASSERT (e->cnt > 0);
+  e->cnt--;
+  wake (get_end (p, !writer));
+  dead = p->reader.cnt == 0 && p->writer.cnt == 0;
+  intr_set_level (old_level);
+
+  if (dead)
+    {
+      palloc_free_page (p->buf);
+      free (p);
+    }
+}
+
+/** Blocks the current thread at end E of P until COND (P) holds,
+   the other end, OTHER, is closed, or the thread is interrupted. */
+static void
+wait_until (struct pipe *p, struct pipe_end *e, struct pipe_end *other,
+            bool (*cond) (const struct pipe *))
+{
+  enum intr_level old_level = intr_disable ();
+
+  while (!cond (p) && other->cnt > 0 && !thread_interrupted ())
+    thread_block_interruptible (&e->waiter);
+  intr_set_level (old_level);
+}
+
+static bool
+is_nonempty (const struct pipe *p)
+{
+  return p->head != p->tail;
+}
+
+static bool
+is_nonfull (const struct pipe *p)
+{
+  return p->head - p->tail < PIPE_SIZE;
+}
+
+/** Reads up to SIZE bytes from P into BUFFER, waiting until at
+   least one byte is available.  Returns the number of bytes read,
+   which is 0 only at end of file, that is, once P is empty and
+   its write end has been closed, or if the current thread is
+   interrupted while it waits. */
+size_t
+pipe_read (struct pipe *p, void *buffer_, size_t size)
+{
+  uint8_t *buffer = buffer_;
+  bool locked = p->reader.shared;
+  uint32_t tail, ofs;
+  size_t n, chunk;
+
+  if (size == 0)
+    return 0;
+  if (locked && !lock_acquire_interruptible (&p->reader.lock))
+    return 0;
+
+  if (!is_nonempty (p))
+    wait_until (p, &p->reader, &p->writer, is_nonempty);
+
+  /* Copy out what is there, in up to two pieces around the end of
+     the ring, then publish the new tail and let the writer go on. */
+  tail = p->tail;
+  n = p->head - tail;
+  if (n > size)
+    n = size;
+  ofs = tail % PIPE_SIZE;
+  chunk = n < PIPE_SIZE - ofs ? n : PIPE_SIZE - ofs;
+  memcpy (buffer, p->buf + ofs, chunk);
+  memcpy (buffer + chunk, p->buf, n - chunk);
+  barrier ();
+  p->tail = tail + n;
+  wake (&p->writer);
+
+  if (locked)
+    lock_release (&p->reader.lock);
+  return n;
+}
+
+/** Writes all SIZE bytes from BUFFER into P, waiting for room as
+   necessary.  Returns the number of bytes written, which is less
+   than SIZE only if P's read end has been closed or the current
+   thread is interrupted while it waits. */
+size_t
+pipe_write (struct pipe *p, const void *buffer_, size_t size)
+{
+  const uint8_t *buffer = buffer_;
+  bool locked = p->writer.shared;
+  size_t done = 0;
+
+  if (locked && !lock_acquire_interruptible (&p->writer.lock))
+    return 0;
+
+  while (done < size && p->reader.cnt > 0 && !thread_interrupted ())
+    {
+      uint32_t head, ofs;
+      size_t n, chunk;
+
+      if (!is_nonfull (p))
+        {
+          wait_until (p, &p->writer, &p->reader, is_nonfull);
+          continue;
+        }
+
+      /* Fill what room there is, then publish the new head and let
+         the reader go on. */
+      head = p->head;
+      n = PIPE_SIZE - (head - p->tail);
+      if (n > size - done)
+        n = size - done;
+      ofs = head % PIPE_SIZE;
+      chunk = n < PIPE_SIZE - ofs ? n : PIPE_SIZE - ofs;
+      memcpy (p->buf + ofs, buffer + done, chunk);
+      memcpy (p->buf, buffer + done + chunk, n - chunk);
+      barrier ();
+      p->head = head + n;
+      wake (&p->reader);
+      done += n;
+    }
+
+  if (locked)
+    lock_release (&p->writer.lock);
+  return done;
+}
@@ -1,119 +1,1493 @@
 #include "userprog/process.h"
+#include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
 #include <round.h>
+#include <rusage.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/futex.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/pipe.h"
+#include "userprog/shm.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
+#include "filesys/cache.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 
+/** A file mapped into a process's address space. */
+struct mmap
+  {
+    struct list_elem elem;      /**< Element in process's `mmaps' list. */
+    int id;                     /**< Mapping identifier. */
+    struct file *file;          /**< File backing the mapping. */
+    uint8_t *addr;              /**< First mapped user page. */
+    size_t page_cnt;            /**< Number of mapped pages. */
+    struct shm *shm;            /**< Shared memory, or null for a file. */
+  };
+
+/** Exit status of a child process, shared between the child and
+   its parent.  The record outlives whichever of the two exits
+   first, so the parent can collect the status after the child's
+   `struct thread' is gone, and neither side ever needs to search
+   the list of all threads. */
+struct child_status
+  {
+    struct list_elem elem;      /**< Element in parent's `children'. */
+    tid_t tid;                  /**< Child's thread identifier. */
+    int exit_status;            /**< Valid once `dead' is up. */
+    struct semaphore dead;      /**< Upped by the child as it exits. */
+    struct lock lock;           /**< Protects `ref_cnt'. */
+    int ref_cnt;                /**< 2 = both alive, 1 = one, 0 = free. */
+  };
+
+/** A thread started by process_thread_create().  The record
+   outlives the thread until another thread of the process joins
+   it or the process exits. */
+struct uthread
+  {
+    struct list_elem elem;      /**< Element in process's `uthreads'. */
+    tid_t tid;                  /**< Thread's identifier. */
+    int slot;                   /**< User stack slot. */
+    int exit_status;            /**< Valid once `done' is up. */
+    bool joining;               /**< Is a thread waiting for it? */
+    struct semaphore done;      /**< Upped by the thread as it exits. */
+    struct process *process;    /**< Process to start in. */
+    void *eip, *esp;            /**< Initial user registers. */
+  };
+
+/** What an open descriptor refers to, shared by all the threads of
+   its process.  A thread using a descriptor holds a reference, so
+   that if another thread closes it meanwhile the file or pipe stays
+   open until the first is done with it. */
+struct open_fd
+  {
+    struct fd_entry entry;      /**< What the descriptor refers to. */
+    int ref_cnt;                /**< Table's reference plus users'. */
+  };
+
+/** A user process: the address space, descriptors and executable
+   shared by all of its threads.  The last of them to exit tears it
+   down.  Members marked [L] are protected by `lock'. */
+struct process
+  {
+    char name[16];              /**< Name, for the exit message. */
+    struct lock lock;           /**< Protects members marked [L]. */
+    int thread_cnt;             /**< Threads still running. [L] */
+    bool threaded;              /**< Has it ever had two threads? [L] */
+    bool exiting;               /**< Are all its threads to exit? [L] */
+    int exit_status;            /**< Status reported on exit. [L] */
+    struct list uthreads;       /**< Threads' join records. [L] */
+    uint32_t stack_slots;       /**< Bit N set: slot N in use. [L] */
+    struct open_fd **fds;       /**< Open descriptors, by number. [L] */
+    struct bitmap *fd_map;      /**< File descriptors in use. [L] */
+    struct rusage rusage;       /**< Resources used by its threads. */
+
+    uint32_t *pagedir;          /**< Page directory. */
+    struct child_status *child_status;  /**< Own status, shared w/parent. */
+    struct file *exec_file;     /**< Executable, denied writes. */
+    struct dir *cwd;            /**< Working dir, null for root. [L] */
+    struct lock mmap_lock;      /**< Protects the four below. */
+    struct list mmaps;          /**< Memory mappings. */
+    int next_mapid;             /**< Next mapping identifier. */
+    struct list pins;           /**< Pinned pages (struct page_pin). */
+  };
+
+/** Information passed from process_execute() to the child's
+   start_process(), which lives on the parent's stack because the
+   parent waits for the child to finish loading. */
+struct exec_info
+  {
+    char *file_name;                    /**< Page holding command line. */
+    const struct spawn_fd *fds;         /**< Descriptors to set up. */
+    size_t fd_cnt;                      /**< Number of FDS. */
+    struct dir *cwd;                    /**< Child's working directory. */
+    struct child_status *status;        /**< Child's status record. */
+    struct semaphore loaded;            /**< Upped when loading is done. */
+    bool success;                       /**< Did loading succeed? */
+  };
+
+/** -rusage: Print each process's resource usage as it exits? */
+bool process_print_rusage;
+
 static thread_func start_process NO_RETURN;
-static bool load (const char *cmdline, void (**eip) (void), void **esp);
+static thread_func start_uthread NO_RETURN;
+static thread_action_func interrupt_sibling;
+static bool load (char *cmd_line, void (**eip) (void), void **esp);
+static void release_child (struct child_status *);
+static bool install_fds (const struct spawn_fd *, size_t cnt);
+static void close_fds (const struct spawn_fd *, size_t cnt);
+static bool range_is_free (uint8_t *upage, size_t page_cnt);
+static void free_user_page (struct process *, void *kpage);
+
+/** Protects the executable image cache; see struct exec_image. */
+static struct lock exec_cache_lock;
+
+/** Initializes the process module. */
+void
+process_init (void) 
+{
+  lock_init (&exec_cache_lock);
+}
+
+/** Starts a new thread running a user program loaded from
+   FILENAME.  Waits until the program has been loaded.  Returns
+   the new process's thread id, or TID_ERROR if the thread cannot
+   be created or the program cannot be loaded. */
+tid_t
+process_execute (const char *file_name) 
+{
+  return process_spawn (file_name, NULL, 0);
+}
+
+/** Like process_execute(), but first sets up the FD_CNT
+   descriptors in FDS, in order, in the new process's descriptor
+   table, which otherwise holds just the console as descriptors 0
+   and 1.  This happens before the program is loaded, so it never
+   runs with any other descriptors.  The new process takes over
+   the files and pipes in FDS; they are released if it cannot be
+   started.  It starts out in the current process's working
+   directory. */
+tid_t
+process_spawn (const char *file_name,
+               const struct spawn_fd *fds, size_t fd_cnt) 
+{
+  struct exec_info exec;
+  struct child_status *cs;
+  char thread_name[16];
+  tid_t tid;
+
+  /* Make a copy of FILE_NAME.
+     Otherwise there's a race between the caller and load(). */
+  exec.file_name = palloc_get_page (0);
+  if (exec.file_name == NULL)
+    {
+      close_fds (fds, fd_cnt);
+      return TID_ERROR;
+    }
+  strlcpy (exec.file_name, file_name, PGSIZE);
+  exec.fds = fds;
+  exec.fd_cnt = fd_cnt;
+
+  /* Create the child's status record, referenced by both of us. */
+  cs = exec.status = malloc (sizeof *cs);
+  if (cs == NULL)
+    {
+      palloc_free_page (exec.file_name);
+      close_fds (fds, fd_cnt);
+      return TID_ERROR;
+    }
+  sema_init (&cs->dead, 0);
+  lock_init (&cs->lock);
+  cs->exit_status = -1;
+  cs->ref_cnt = 2;
+  sema_init (&exec.loaded, 0);
+  exec.success = false;
+
+  /* Give the child its own reference to our working directory,
+     since another of our threads may change ours meanwhile. */
+  exec.cwd = process_open_cwd ();
+  if (exec.cwd == NULL)
+    {
+      palloc_free_page (exec.file_name);
+      free (cs);
+      close_fds (fds, fd_cnt);
+      return TID_ERROR;
+    }
+
+  /* Name the thread after the program, the command's first
+     word. */
+  strlcpy (thread_name, file_name + strspn (file_name, " "),
+           sizeof thread_name);
+  thread_name[strcspn (thread_name, " ")] = '\0';
+
+  /* Create a new thread to execute FILE_NAME. */
+  tid = thread_create (thread_name, PRI_DEFAULT, start_process, &exec);
+  if (tid == TID_ERROR)
+    {
+      palloc_free_page (exec.file_name);
+      free (cs);
+      close_fds (fds, fd_cnt);
+      dir_close (exec.cwd);
+      return TID_ERROR;
+    }
+
+  /* Wait for the child to load.  A child that fails to load exits
+     at once; nobody can wait for it, so drop our reference. */
+  sema_down (&exec.loaded);
+  if (!exec.success)
+    {
+      release_child (cs);
+      return TID_ERROR;
+    }
+  cs->tid = tid;
+  list_push_back (&thread_current ()->children, &cs->elem);
+  return tid;
+}
+
+/** Creates the process for the current thread, which becomes its
+   first thread, with status record CS and working directory CWD,
+   which it takes over.  Returns the process, or a null pointer if
+   memory is short. */
+static struct process *
+create_process (struct child_status *cs, struct dir *cwd)
+{
+  struct thread *cur = thread_current ();
+  struct process *p = calloc (1, sizeof *p);
+
+  if (p == NULL)
+    return NULL;
+  strlcpy (p->name, cur->name, sizeof p->name);
+  lock_init (&p->lock);
+  p->thread_cnt = 1;
+  p->exit_status = -1;
+  list_init (&p->uthreads);
+  p->stack_slots = 1;
+  p->child_status = cs;
+  p->cwd = cwd;
+  lock_init (&p->mmap_lock);
+  list_init (&p->mmaps);
+  list_init (&p->pins);
+  cur->process = p;
+  cur->rusage = &p->rusage;
+  return p;
+}
+
+/** A thread function that loads a user process and starts it
+   running. */
+static void
+start_process (void *exec_)
+{
+  struct exec_info *exec = exec_;
+  struct intr_frame if_;
+  bool success;
+
+  /* Initialize interrupt frame and load executable. */
+  memset (&if_, 0, sizeof if_);
+  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+  if_.cs = SEL_UCSEG;
+  if_.eflags = FLAG_IF | FLAG_MBS;
+  if (create_process (exec->status, exec->cwd) != NULL)
+    success = (install_fds (exec->fds, exec->fd_cnt)
+               && load (exec->file_name, &if_.eip, &if_.esp));
+  else
+    {
+      release_child (exec->status);
+      close_fds (exec->fds, exec->fd_cnt);
+      dir_close (exec->cwd);
+      success = false;
+    }
+
+  /* Report the result to our parent.  EXEC is on the parent's
+     stack, so we must not touch it after upping the semaphore. */
+  palloc_free_page (exec->file_name);
+  exec->success = success;
+  sema_up (&exec->loaded);
+
+  /* If load failed, quit. */
+  if (!success) 
+    thread_exit ();
+
+  /* Start the user process by simulating a return from an
+     interrupt, implemented by intr_exit (in
+     threads/intr-stubs.S).  Because intr_exit takes all of its
+     arguments on the stack in the form of a `struct intr_frame',
+     we just point the stack pointer (%esp) to our stack frame
+     and jump to it. */
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/** Drops one reference to CS, freeing it when neither the parent
+   nor the child refers to it any longer. */
+static void
+release_child (struct child_status *cs)
+{
+  int ref_cnt;
+
+  lock_acquire (&cs->lock);
+  ref_cnt = --cs->ref_cnt;
+  lock_release (&cs->lock);
+
+  if (ref_cnt == 0)
+    free (cs);
+}
+
+/** Waits for thread TID to die and returns its exit status.  If
+   it was terminated by the kernel (i.e. killed due to an
+   exception), returns -1.  If TID is invalid or if it was not a
+   child of the calling thread, or if process_wait() has already
+   been successfully called for the given TID, returns -1
+   immediately, without waiting.  Only the thread that started a
+   child can wait for it, even within one process. */
+int
+process_wait (tid_t child_tid) 
+{
+  struct thread *cur = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&cur->children); e != list_end (&cur->children);
+       e = list_next (e))
+    {
+      struct child_status *cs = list_entry (e, struct child_status, elem);
+
+      if (cs->tid == child_tid)
+        {
+          int exit_status;
+
+          sema_down (&cs->dead);
+          exit_status = cs->exit_status;
+          list_remove (&cs->elem);
+          release_child (cs);
+          return exit_status;
+        }
+    }
+  return -1;
+}
+
+/** Returns the user stack page of the thread in stack slot SLOT.
+   Slot 0, at the top of user memory, belongs to the process's
+   first thread.  Each slot below is one page under the next, with
+   an unmapped guard page between them, so that a thread that
+   overruns its stack faults instead of corrupting another's. */
+static uint8_t *
+stack_slot_page (int slot)
+{
+  return (uint8_t *) PHYS_BASE - (2 * slot + 1) * PGSIZE;
+}
+
+/** Prints the resources that process P has used. */
+static void
+print_rusage (const struct process *p)
+{
+  const struct rusage *u = &p->rusage;
+  int i;
+
+  printf ("%s: rusage: %u ticks, %u page faults, "
+          "%u sectors read, %u written\n",
+          p->name, u->ticks, u->page_faults,
+          u->sectors_read, u->sectors_written);
+  printf ("%s: rusage: syscalls", p->name);
+  for (i = 0; i < RUSAGE_SYSCALLS; i++)
+    if (u->syscalls[i] != 0)
+      printf (" %d:%u", i, u->syscalls[i]);
+  printf ("\n");
+}
+
+/** Tears down process P, whose last thread is the current one. */
+static void
+destroy_process (struct process *p)
+{
+  struct thread *cur = thread_current ();
+  uint32_t *pd;
+
+  /* Only processes that got as far as loading report their exit
+     status. */
+  if (p->pagedir != NULL)
+    {
+      printf ("%s: exit(%d)\n", p->name, p->exit_status);
+      if (process_print_rusage)
+        print_rusage (p);
+    }
+
+  /* Write back and remove memory mappings while the page
+     directory that holds them still exists. */
+  while (!list_empty (&p->mmaps))
+    {
+      struct mmap *m = list_entry (list_front (&p->mmaps),
+                                   struct mmap, elem);
+      process_munmap (m->id);
+    }
+
+  /* Close open descriptors, and the executable, which allows
+     writes to it again.  No thread is left to hold a reference to
+     a descriptor, so the table holds the only ones. */
+  if (p->fds != NULL)
+    {
+      int fd;
+
+      for (fd = 0; fd < (int) bitmap_size (p->fd_map); fd++)
+        if (p->fds[fd] != NULL)
+          {
+            ASSERT (p->fds[fd]->ref_cnt == 1);
+            process_release_fd (&p->fds[fd]->entry);
+            free (p->fds[fd]);
+          }
+      free (p->fds);
+      bitmap_destroy (p->fd_map);
+    }
+  file_close (p->exec_file);
+  dir_close (p->cwd);
+
+  /* Free the join records of threads nobody joined. */
+  while (!list_empty (&p->uthreads))
+    {
+      struct list_elem *e = list_pop_front (&p->uthreads);
+      free (list_entry (e, struct uthread, elem));
+    }
+
+  /* Report our exit status to our parent, if any.  This comes
+     after everything above, so that by the time wait() returns our
+     mappings are written back and our executable is writable. */
+  if (p->child_status != NULL)
+    {
+      p->child_status->exit_status = p->exit_status;
+      sema_up (&p->child_status->dead);
+      release_child (p->child_status);
+    }
+
+  /* Destroy the process's page directory and switch back to the
+     kernel-only page directory.  Correct ordering here is
+     crucial.  We must set cur->pagedir to NULL before switching
+     page directories, so that a timer interrupt can't switch back
+     to the process page directory.  We must activate the base
+     page directory before destroying the process's page
+     directory, or our active page directory will be one that's
+     been freed (and cleared). */
+  pd = p->pagedir;
+  cur->pagedir = NULL;
+  cur->process = NULL;
+  cur->rusage = NULL;
+  cache_forget_rusage (&p->rusage);
+  free (p);
+  if (pd != NULL) 
+    {
+      pagedir_activate (NULL);
+      pagedir_destroy (pd);
+    }
+}
+
+/** Ends the current thread's part in its process, tearing the
+   process down if this is its last thread. */
+void
+process_exit (void)
+{
+  struct thread *cur = thread_current ();
+  struct process *p = cur->process;
+  struct uthread *u = cur->uthread;
+  bool last;
+
+  /* Let go of our children's status records. */
+  while (!list_empty (&cur->children))
+    {
+      struct list_elem *e = list_pop_front (&cur->children);
+      release_child (list_entry (e, struct child_status, elem));
+    }
+  if (p == NULL)
+    return;
+
+  /* Free our user stack, unless it is the first thread's, which
+     goes with the page directory. */
+  if (u != NULL)
+    {
+      uint8_t *upage = stack_slot_page (u->slot);
+      void *kpage;
+
+      lock_acquire (&p->mmap_lock);
+      kpage = pagedir_get_page (p->pagedir, upage);
+      pagedir_clear_page (p->pagedir, upage);
+      free_user_page (p, kpage);
+      lock_release (&p->mmap_lock);
+    }
+
+  /* Once we are off the count, the last thread may destroy the
+     page directory at any time, so stop using it first. */
+  lock_acquire (&p->lock);
+  if (u != NULL)
+    {
+      p->stack_slots &= ~(1u << u->slot);
+      sema_up (&u->done);
+    }
+  if (p->thread_cnt == 1)
+    last = true;
+  else
+    {
+      last = false;
+      cur->pagedir = NULL;
+      cur->process = NULL;
+      cur->rusage = NULL;
+      p->thread_cnt--;
+    }
+  lock_release (&p->lock);
+  cur->uthread = NULL;
+
+  if (last)
+    destroy_process (p);
+}
+
+/** Terminates the current process with exit status STATUS.  The
+   calling thread exits at once, and the process's other threads
+   the next time they are about to return to user mode; see
+   process_check_exit().  If several threads end the process, the
+   first one's status is reported. */
+void
+process_exit_all (int status)
+{
+  struct process *p = thread_current ()->process;
+  enum intr_level old_level;
+
+  lock_acquire (&p->lock);
+  if (!p->exiting)
+    {
+      p->exiting = true;
+      p->exit_status = status;
+    }
+  lock_release (&p->lock);
+
+  /* Wake the other threads wherever they sleep waiting on something
+     that might never happen, such as a pipe whose writer is one of
+     them, so that they return and exit too.  A thread that enters
+     such a wait later gives up at once. */
+  old_level = intr_disable ();
+  thread_foreach (interrupt_sibling, p);
+  intr_set_level (old_level);
+  futex_wake_process (p);
+  thread_exit ();
+}
+
+/** Interrupts thread T if it belongs to process P_ and is not the
+   running thread.  A thread_action_func for process_exit_all(). */
+static void
+interrupt_sibling (struct thread *t, void *p_)
+{
+  struct process *p = p_;
+
+  if (t->process == p && t != thread_current ())
+    thread_interrupt (t);
+}
+
+/** Terminates the current process with exit status -1, as
+   happens when it passes a bad pointer or file descriptor to a
+   system call. */
+void
+process_kill (void)
+{
+  process_exit_all (-1);
+}
+
+/** Exits the current thread if its process is exiting.  Called
+   whenever a thread is about to return to user mode. */
+void
+process_check_exit (void)
+{
+  struct process *p = thread_current ()->process;
+
+  if (p != NULL && p->exiting)
+    {
+      intr_enable ();
+      thread_exit ();
+    }
+}
+
+/** Starts a new thread in the current process that enters user
+   mode at EIP, with FUNC and AUX as the arguments of a function
+   called with a null return address, on a stack page of its own.
+   Returns the new thread's identifier, or TID_ERROR if the process
+   already has UTHREAD_MAX threads, is exiting, or memory is
+   short. */
+tid_t
+process_thread_create (void *eip, void *func, void *aux)
+{
+  struct process *p = thread_current ()->process;
+  struct uthread *u;
+  uint8_t *kpage, *upage;
+  uint32_t *args;
+  bool ok;
+  tid_t tid;
+
+  u = malloc (sizeof *u);
+  if (u == NULL)
+    return TID_ERROR;
+  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+  if (kpage == NULL)
+    {
+      free (u);
+      return TID_ERROR;
+    }
+
+  /* Claim a stack slot.  The first time the process gets a second
+     thread, its pipe ends have to start taking turns, because
+     two threads might now use one descriptor at once; see
+     pipe_share().  No transfer can be under way then, since the
+     current thread is the only one. */
+  lock_acquire (&p->lock);
+  for (u->slot = 1; u->slot < UTHREAD_MAX; u->slot++)
+    if ((p->stack_slots & (1u << u->slot)) == 0)
+      break;
+  if (u->slot >= UTHREAD_MAX || p->exiting)
+    {
+      lock_release (&p->lock);
+      palloc_free_page (kpage);
+      free (u);
+      return TID_ERROR;
+    }
+  if (!p->threaded)
+    {
+      int fd;
+
+      p->threaded = true;
+      if (p->fds != NULL)
+        for (fd = 0; fd < (int) bitmap_size (p->fd_map); fd++)
+          if (p->fds[fd] != NULL && p->fds[fd]->entry.pipe != NULL)
+            pipe_share (p->fds[fd]->entry.pipe,
+                        p->fds[fd]->entry.pipe_writer);
+    }
+  p->stack_slots |= 1u << u->slot;
+  p->thread_cnt++;
+  u->tid = TID_ERROR;
+  u->exit_status = -1;
+  u->joining = false;
+  sema_init (&u->done, 0);
+  list_push_back (&p->uthreads, &u->elem);
+  lock_release (&p->lock);
+
+  /* Map the stack with the arguments on it. */
+  upage = stack_slot_page (u->slot);
+  lock_acquire (&p->mmap_lock);
+  ok = (range_is_free (upage, 1)
+        && pagedir_set_page (p->pagedir, upage, kpage, true));
+  lock_release (&p->mmap_lock);
+  if (!ok)
+    {
+      palloc_free_page (kpage);
+      goto fail;
+    }
+  args = (uint32_t *) (kpage + PGSIZE) - 3;
+  args[0] = 0;
+  args[1] = (uint32_t) func;
+  args[2] = (uint32_t) aux;
+  u->process = p;
+  u->eip = eip;
+  u->esp = upage + PGSIZE - 3 * sizeof *args;
+
+  tid = thread_create (p->name, PRI_DEFAULT, start_uthread, u);
+  if (tid == TID_ERROR)
+    {
+      lock_acquire (&p->mmap_lock);
+      pagedir_clear_page (p->pagedir, upage);
+      free_user_page (p, kpage);
+      lock_release (&p->mmap_lock);
+      goto fail;
+    }
+
+  lock_acquire (&p->lock);
+  u->tid = tid;
+  lock_release (&p->lock);
+  return tid;
+
+ fail:
+  lock_acquire (&p->lock);
+  p->stack_slots &= ~(1u << u->slot);
+  p->thread_cnt--;
+  list_remove (&u->elem);
+  lock_release (&p->lock);
+  free (u);
+  return TID_ERROR;
+}
+
+/** A thread function that joins a process as the thread described
+   by U_ and enters user mode. */
+static void
+start_uthread (void *u_)
+{
+  struct uthread *u = u_;
+  struct thread *cur = thread_current ();
+  struct intr_frame if_;
+
+  cur->process = u->process;
+  cur->uthread = u;
+  cur->pagedir = u->process->pagedir;
+  cur->rusage = &u->process->rusage;
+  process_activate ();
+
+  memset (&if_, 0, sizeof if_);
+  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+  if_.cs = SEL_UCSEG;
+  if_.eflags = FLAG_IF | FLAG_MBS;
+  if_.eip = u->eip;
+  if_.esp = u->esp;
+
+  /* Jump to user mode as start_process() does, unless the process
+     began to exit meanwhile. */
+  process_check_exit ();
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/** Waits for thread TID of the current process, started with
+   process_thread_create(), to exit and returns the status it
+   passed to process_thread_exit(), or -1 if it was killed.
+   Returns -1 at once if TID is no such thread, is the caller, or
+   has already been joined or is being joined, and returns -1
+   without waiting further if the process starts to exit. */
+int
+process_thread_join (tid_t tid)
+{
+  struct process *p = thread_current ()->process;
+  struct uthread *u = NULL;
+  struct list_elem *e;
+  int exit_status;
+
+  if (tid == thread_tid ())
+    return -1;
+
+  lock_acquire (&p->lock);
+  for (e = list_begin (&p->uthreads); e != list_end (&p->uthreads);
+       e = list_next (e))
+    {
+      struct uthread *v = list_entry (e, struct uthread, elem);
+      if (v->tid == tid && !v->joining)
+        {
+          u = v;
+          u->joining = true;
+          break;
+        }
+    }
+  lock_release (&p->lock);
+  if (u == NULL)
+    return -1;
+
+  if (!sema_down_interruptible (&u->done))
+    {
+      /* The process is exiting.  Leave U for destroy_process(). */
+      lock_acquire (&p->lock);
+      u->joining = false;
+      lock_release (&p->lock);
+      return -1;
+    }
+  exit_status = u->exit_status;
+  lock_acquire (&p->lock);
+  list_remove (&u->elem);
+  lock_release (&p->lock);
+  free (u);
+  return exit_status;
+}
+
+/** Exits the current thread with status STATUS, which a thread
+   joining it receives.  The rest of the process goes on; when its
+   last thread exits this way, STATUS becomes the process's exit
+   status. */
+void
+process_thread_exit (int status)
+{
+  struct thread *cur = thread_current ();
+  struct process *p = cur->process;
+
+  lock_acquire (&p->lock);
+  if (cur->uthread != NULL)
+    cur->uthread->exit_status = status;
+  if (!p->exiting)
+    p->exit_status = status;
+  lock_release (&p->lock);
+  thread_exit ();
+}
+
+/** Resizes P's file descriptor table to hold CNT descriptors,
+   which must be more than it holds now.  Returns true if
+   successful, false if memory allocation fails.  Must be called
+   with P's lock held. */
+static bool
+grow_fds (struct process *p, size_t cnt)
+{
+  size_t old_cnt = p->fd_map != NULL ? bitmap_size (p->fd_map) : 0;
+  struct bitmap *fd_map;
+  struct open_fd **fds;
+  size_t fd;
+
+  ASSERT (cnt > old_cnt);
+
+  fd_map = bitmap_create (cnt);
+  if (fd_map == NULL)
+    return false;
+  fds = realloc (p->fds, cnt * sizeof *fds);
+  if (fds == NULL)
+    {
+      bitmap_destroy (fd_map);
+      return false;
+    }
+  memset (fds + old_cnt, 0, (cnt - old_cnt) * sizeof *fds);
+
+  if (p->fd_map != NULL)
+    {
+      for (fd = 0; fd < old_cnt; fd++)
+        bitmap_set (fd_map, fd, bitmap_test (p->fd_map, fd));
+      bitmap_destroy (p->fd_map);
+    }
+  else
+    {
+      /* Reserve the console descriptors. */
+      bitmap_mark (fd_map, STDIN_FILENO);
+      bitmap_mark (fd_map, STDOUT_FILENO);
+    }
+
+  p->fds = fds;
+  p->fd_map = fd_map;
+  return true;
+}
+
+/** Returns a new open descriptor for E with a single reference,
+   for process P, or a null pointer if memory is short. */
+static struct open_fd *
+new_open_fd (struct process *p, const struct fd_entry *e)
+{
+  struct open_fd *of = malloc (sizeof *of);
+
+  if (of != NULL)
+    {
+      of->entry = *e;
+      of->ref_cnt = 1;
+      if (p->threaded && e->pipe != NULL)
+        pipe_share (e->pipe, e->pipe_writer);
+    }
+  return of;
+}
+
+/** Adds a descriptor for E to the current process's file
+   descriptor table and returns it, which is the lowest descriptor
+   not in use, or -1 if the process already has FD_MAX descriptors
+   or memory allocation fails.  Descriptors 0 and 1 are reserved
+   for the console. */
+int
+process_add_fd (const struct fd_entry *e)
+{
+  struct process *p = thread_current ()->process;
+  struct open_fd *of;
+  size_t fd;
+
+  lock_acquire (&p->lock);
+  of = new_open_fd (p, e);
+  if (of == NULL || (p->fd_map == NULL && !grow_fds (p, FD_MIN)))
+    goto fail;
+
+  fd = bitmap_scan_and_flip (p->fd_map, 0, 1, false);
+  if (fd == BITMAP_ERROR)
+    {
+      /* Table full: double it.  The first new slot is free. */
+      size_t cnt = bitmap_size (p->fd_map);
+      size_t new_cnt = cnt * 2 < FD_MAX ? cnt * 2 : FD_MAX;
+
+      if (cnt >= FD_MAX || !grow_fds (p, new_cnt))
+        goto fail;
+      fd = cnt;
+      bitmap_mark (p->fd_map, fd);
+    }
+
+  p->fds[fd] = of;
+  lock_release (&p->lock);
+  return fd;
+
+ fail:
+  lock_release (&p->lock);
+  free (of);
+  return -1;
+}
+
+/** Returns what FD refers to in the current process, or a null
+   pointer if FD is not open or is the console.  The caller must
+   release the result with process_put_fd(), and until then it
+   stays valid even if another thread closes FD. */
+const struct fd_entry *
+process_get_fd (int fd)
+{
+  struct process *p = thread_current ()->process;
+  struct open_fd *of = NULL;
+
+  lock_acquire (&p->lock);
+  if (p->fd_map != NULL && fd >= 0 && (size_t) fd < bitmap_size (p->fd_map))
+    {
+      of = p->fds[fd];
+      if (of != NULL)
+        of->ref_cnt++;
+    }
+  lock_release (&p->lock);
+  return of != NULL ? &of->entry : NULL;
+}
+
+/** Releases E, obtained from process_get_fd(), closing what it
+   refers to if its descriptor has been closed meanwhile. */
+void
+process_put_fd (const struct fd_entry *e)
+{
+  struct process *p = thread_current ()->process;
+  struct open_fd *of;
+  bool last;
+
+  of = (struct open_fd *) ((uint8_t *) e - offsetof (struct open_fd, entry));
+  lock_acquire (&p->lock);
+  last = --of->ref_cnt == 0;
+  lock_release (&p->lock);
+
+  if (last)
+    {
+      process_release_fd (&of->entry);
+      free (of);
+    }
+}
+
+/** Returns true if FD is one of the console descriptors, 0 or 1,
+   and still refers to the console in the current process, that
+   is, it has been neither closed nor redirected. */
+bool
+process_is_console (int fd)
+{
+  struct process *p = thread_current ()->process;
+  bool console;
+
+  if (fd != STDIN_FILENO && fd != STDOUT_FILENO)
+    return false;
+  lock_acquire (&p->lock);
+  console = (p->fd_map == NULL
+             || (bitmap_test (p->fd_map, fd) && p->fds[fd] == NULL));
+  lock_release (&p->lock);
+  return console;
+}
+
+/** Makes a new reference to what FD refers to in the current
+   process and stores it in *COPY.  A file is reopened at the same
+   position, since processes do not share open files.  Returns
+   false if FD is closed or the console, or if memory is short. */
+bool
+process_dup_fd (int fd, struct fd_entry *copy)
+{
+  const struct fd_entry *e = process_get_fd (fd);
+  bool success = true;
+
+  if (e == NULL)
+    return false;
+  *copy = *e;
+  if (e->file != NULL)
+    {
+      copy->file = file_reopen (e->file);
+      if (copy->file != NULL)
+        file_seek (copy->file, file_tell (e->file));
+      success = copy->file != NULL;
+    }
+  else if (e->dir != NULL)
+    {
+      copy->dir = dir_reopen (e->dir);
+      success = copy->dir != NULL;
+    }
+  else if (e->pipe != NULL)
+    pipe_dup (e->pipe, e->pipe_writer);
+  else if (e->shm != NULL)
+    shm_dup (e->shm);
+  process_put_fd (e);
+  return success;
+}
+
+/** Drops the reference to the file, directory, pipe or shared
+   memory in E, if any. */
+void
+process_release_fd (const struct fd_entry *e)
+{
+  if (e->file != NULL || e->dir != NULL)
+    {
+      file_close (e->file);
+      dir_close (e->dir);
+    }
+  else if (e->pipe != NULL)
+    pipe_close (e->pipe, e->pipe_writer);
+  else if (e->shm != NULL)
+    shm_close (e->shm);
+}
+
+/** Closes FD in the current process and makes it available for
+   reuse.  Returns false, doing nothing, if FD is not open or is
+   the console. */
+bool
+process_close_fd (int fd)
+{
+  struct process *p = thread_current ()->process;
+  struct open_fd *of = NULL;
+
+  lock_acquire (&p->lock);
+  if (p->fd_map != NULL && fd >= 0 && (size_t) fd < bitmap_size (p->fd_map))
+    {
+      of = p->fds[fd];
+      if (of != NULL)
+        {
+          p->fds[fd] = NULL;
+          bitmap_reset (p->fd_map, fd);
+        }
+    }
+  lock_release (&p->lock);
+
+  if (of == NULL)
+    return false;
+  process_put_fd (&of->entry);
+  return true;
+}
+
+/** Makes FD refer to E in the current process, closing whatever FD
+   referred to before, even the console.  If E refers to neither a
+   file nor a pipe, just closes FD.  Returns true if successful,
+   false if memory allocation fails, in which case E is left
+   alone. */
+static bool
+set_fd (int fd, const struct fd_entry *e)
+{
+  struct process *p = thread_current ()->process;
+  struct open_fd *of = NULL, *old;
+  size_t cnt;
+
+  ASSERT (fd >= 0 && fd < FD_MAX);
+
+  lock_acquire (&p->lock);
+  if (fd_entry_is_open (e))
+    {
+      of = new_open_fd (p, e);
+      if (of == NULL)
+        goto fail;
+    }
+
+  cnt = p->fd_map != NULL ? bitmap_size (p->fd_map) : 0;
+  if ((size_t) fd >= cnt)
+    {
+      size_t new_cnt = cnt > 0 ? cnt : FD_MIN;
+
+      /* Closing a descriptor beyond the table is a no-op, except
+         that the console descriptors exist before the table. */
+      if (of == NULL && (cnt > 0 || fd > STDOUT_FILENO))
+        {
+          lock_release (&p->lock);
+          return true;
+        }
+      while (new_cnt <= (size_t) fd)
+        new_cnt *= 2;
+      if (!grow_fds (p, new_cnt))
+        goto fail;
+    }
+
+  old = p->fds[fd];
+  p->fds[fd] = of;
+  bitmap_set (p->fd_map, fd, of != NULL);
+  lock_release (&p->lock);
+
+  if (old != NULL)
+    process_put_fd (&old->entry);
+  return true;
+
+ fail:
+  lock_release (&p->lock);
+  free (of);
+  return false;
+}
 
-/** Starts a new thread running a user program loaded from
-   FILENAME.  The new thread may be scheduled (and may even exit)
-   before process_execute() returns.  Returns the new process's
-   thread id, or TID_ERROR if the thread cannot be created. */
-tid_t
-process_execute (const char *file_name) 
+/** Sets up the CNT descriptors in FDS, in order, in the current
+   process.  Returns true if successful.  If memory runs out,
+   releases the files and pipes that could not be installed and
+   returns false. */
+static bool
+install_fds (const struct spawn_fd *fds, size_t cnt)
 {
-  char *fn_copy;
-  tid_t tid;
-
-  /* Make a copy of FILE_NAME.
-     Otherwise there's a race between the caller and load(). */
-  fn_copy = palloc_get_page (0);
-  if (fn_copy == NULL)
-    return TID_ERROR;
-  strlcpy (fn_copy, file_name, PGSIZE);
+  bool success = true;
+  size_t i;
 
-  /* Create a new thread to execute FILE_NAME. */
-  tid = thread_create (file_name, PRI_DEFAULT, start_process, fn_copy);
-  if (tid == TID_ERROR)
-    palloc_free_page (fn_copy); 
-  return tid;
+  for (i = 0; i < cnt; i++)
+    if (!success || !set_fd (fds[i].fd, &fds[i].entry))
+      {
+        process_release_fd (&fds[i].entry);
+        success = false;
+      }
+  return success;
 }
 
-/** A thread function that loads a user process and starts it
-   running. */
+/** Releases the files and pipes in the CNT descriptors in FDS. */
 static void
-start_process (void *file_name_)
+close_fds (const struct spawn_fd *fds, size_t cnt)
 {
-  char *file_name = file_name_;
-  struct intr_frame if_;
-  bool success;
+  size_t i;
 
-  /* Initialize interrupt frame and load executable. */
-  memset (&if_, 0, sizeof if_);
-  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
-  if_.cs = SEL_UCSEG;
-  if_.eflags = FLAG_IF | FLAG_MBS;
-  success = load (file_name, &if_.eip, &if_.esp);
+  for (i = 0; i < cnt; i++)
+    process_release_fd (&fds[i].entry);
+}
 
-  /* If load failed, quit. */
-  palloc_free_page (file_name);
-  if (!success) 
-    thread_exit ();
+/** Returns true if the PAGE_CNT pages starting at user page UPAGE
+   all lie in user memory and are unmapped in the current process,
+   false otherwise. */
+static bool
+range_is_free (uint8_t *upage, size_t page_cnt)
+{
+  struct thread *cur = thread_current ();
+  size_t i;
 
-  /* Start the user process by simulating a return from an
-     interrupt, implemented by intr_exit (in
-     threads/intr-stubs.S).  Because intr_exit takes all of its
-     arguments on the stack in the form of a `struct intr_frame',
-     we just point the stack pointer (%esp) to our stack frame
-     and jump to it. */
-  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
-  NOT_REACHED ();
+  for (i = 0; i < page_cnt; i++)
+    if (!is_user_vaddr (upage + i * PGSIZE + PGSIZE - 1)
+        || pagedir_get_page (cur->pagedir, upage + i * PGSIZE) != NULL)
+      return false;
+  return true;
 }
 
-/** Waits for thread TID to die and returns its exit status.  If
-   it was terminated by the kernel (i.e. killed due to an
-   exception), returns -1.  If TID is invalid or if it was not a
-   child of the calling process, or if process_wait() has already
-   been successfully called for the given TID, returns -1
-   immediately, without waiting.
+/** Opens and returns the current process's working directory, or
+   the root directory if it has none or the current thread belongs
+   to no user process.  Returns a null pointer if memory is short;
+   in particular, never falls back to the root directory in place
+   of a working directory that could not be reopened. */
+struct dir *
+process_open_cwd (void)
+{
+  struct process *p = thread_current ()->process;
+  struct dir *cwd = NULL;
+  bool has_cwd = false;
+
+  if (p != NULL)
+    {
+      lock_acquire (&p->lock);
+      if (p->cwd != NULL)
+        {
+          has_cwd = true;
+          cwd = dir_reopen (p->cwd);
+        }
+      lock_release (&p->lock);
+    }
+  return has_cwd ? cwd : dir_open_root ();
+}
+
+/** Makes DIR, which it takes over, the current process's working
+   directory, and closes the old one. */
+void
+process_chdir (struct dir *dir)
+{
+  struct process *p = thread_current ()->process;
+  struct dir *old;
+
+  lock_acquire (&p->lock);
+  old = p->cwd;
+  p->cwd = dir;
+  lock_release (&p->lock);
+  dir_close (old);
+}
+
+/** Maps FILE into the current process's address space starting
+   at user page ADDR and returns the mapping's identifier, or -1
+   if the mapping cannot be created.  The file's contents are read
+   in immediately; the last page is padded with zeros.  Fails if
+   FILE is empty, if ADDR is null or not page-aligned, or if any
+   page of the range is already mapped. */
+int
+process_mmap (struct file *file, void *addr)
+{
+  struct thread *cur = thread_current ();
+  struct process *p = cur->process;
+  struct mmap *m;
+  uint8_t *upage = addr;
+  off_t length;
+  size_t i;
+
+  if (upage == NULL || pg_ofs (upage) != 0)
+    return -1;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return -1;
+
+  length = file_length (file);
+  m->file = file_reopen (file);
+  if (length == 0 || m->file == NULL)
+    goto fail;
+
+  m->addr = upage;
+  m->page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  m->shm = NULL;
+  lock_acquire (&p->mmap_lock);
+  if (!range_is_free (upage, m->page_cnt))
+    goto fail_unlock;
+
+  for (i = 0; i < m->page_cnt; i++)
+    {
+      off_t ofs = i * PGSIZE;
+      size_t page_read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+      uint8_t *kpage = palloc_get_page (PAL_USER);
+      bool ok;
+
+      if (kpage == NULL)
+        goto fail_unmap;
+
+      ok = file_read_at (m->file, kpage, page_read_bytes, ofs)
+           == (off_t) page_read_bytes;
+      memset (kpage + page_read_bytes, 0, PGSIZE - page_read_bytes);
+
+      if (!ok || !pagedir_set_page (cur->pagedir, upage + ofs, kpage, true))
+        {
+          palloc_free_page (kpage);
+          goto fail_unmap;
+        }
+    }
+
+  m->id = p->next_mapid++;
+  list_push_back (&p->mmaps, &m->elem);
+  lock_release (&p->mmap_lock);
+  return m->id;
+
+ fail_unmap:
+  while (i-- > 0)
+    {
+      void *page = upage + i * PGSIZE;
+      void *kpage = pagedir_get_page (cur->pagedir, page);
+
+      pagedir_clear_page (cur->pagedir, page);
+      palloc_free_page (kpage);
+    }
+ fail_unlock:
+  lock_release (&p->mmap_lock);
+ fail:
+  file_close (m->file);
+  free (m);
+  return -1;
+}
 
-   This function will be implemented in problem 2-2.  For now, it
-   does nothing. */
+/** Maps shared memory region SHM into the current process's
+   address space starting at user page ADDR, writable, and returns
+   the mapping's identifier, or -1 if the mapping cannot be
+   created.  Every process that attaches SHM sees the same frames.
+   Fails if ADDR is null or not page-aligned, or if any page of the
+   range is already mapped. */
 int
-process_wait (tid_t child_tid UNUSED) 
+process_shm_attach (struct shm *shm, void *addr)
 {
+  struct thread *cur = thread_current ();
+  struct process *p = cur->process;
+  struct mmap *m;
+  uint8_t *upage = addr;
+  size_t i;
+
+  if (upage == NULL || pg_ofs (upage) != 0)
+    return -1;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return -1;
+  m->file = NULL;
+  m->addr = upage;
+  m->page_cnt = shm_page_cnt (shm);
+  m->shm = shm;
+
+  lock_acquire (&p->mmap_lock);
+  if (!range_is_free (upage, m->page_cnt))
+    goto fail;
+  for (i = 0; i < m->page_cnt; i++)
+    if (!pagedir_set_page (cur->pagedir, upage + i * PGSIZE,
+                           shm_get_page (shm, i), true))
+      {
+        while (i-- > 0)
+          pagedir_clear_page (cur->pagedir, upage + i * PGSIZE);
+        goto fail;
+      }
+
+  shm_dup (shm);
+  m->id = p->next_mapid++;
+  list_push_back (&p->mmaps, &m->elem);
+  lock_release (&p->mmap_lock);
+  return m->id;
+
+ fail:
+  lock_release (&p->mmap_lock);
+  free (m);
   return -1;
 }
 
-/** Free the current process's resources. */
+/** Removes the current process's memory mapping MAPID.  For a
+   file mapping, writes pages that were modified back to the file;
+   shared memory simply loses a reference.  Does nothing if there
+   is no such mapping.  Pages that another thread's system call
+   has pinned are freed when it unpins them. */
 void
-process_exit (void)
+process_munmap (int mapid)
 {
   struct thread *cur = thread_current ();
-  uint32_t *pd;
+  struct process *p = cur->process;
+  struct list_elem *e;
 
-  /* Destroy the current process's page directory and switch back
-     to the kernel-only page directory. */
-  pd = cur->pagedir;
-  if (pd != NULL) 
+  lock_acquire (&p->mmap_lock);
+  for (e = list_begin (&p->mmaps); e != list_end (&p->mmaps);
+       e = list_next (e))
     {
-      /* Correct ordering here is crucial.  We must set
-         cur->pagedir to NULL before switching page directories,
-         so that a timer interrupt can't switch back to the
-         process page directory.  We must activate the base page
-         directory before destroying the process's page
-         directory, or our active page directory will be one
-         that's been freed (and cleared). */
-      cur->pagedir = NULL;
-      pagedir_activate (NULL);
-      pagedir_destroy (pd);
+      struct mmap *m = list_entry (e, struct mmap, elem);
+
+      if (m->id == mapid && m->shm != NULL)
+        {
+          size_t i;
+
+          for (i = 0; i < m->page_cnt; i++)
+            pagedir_clear_page (cur->pagedir, m->addr + i * PGSIZE);
+          shm_close (m->shm);
+
+          list_remove (&m->elem);
+          free (m);
+          break;
+        }
+      else if (m->id == mapid)
+        {
+          off_t length;
+          size_t i;
+
+          length = file_length (m->file);
+          for (i = 0; i < m->page_cnt; i++)
+            {
+              uint8_t *upage = m->addr + i * PGSIZE;
+              uint8_t *kpage = pagedir_get_page (cur->pagedir, upage);
+              off_t ofs = i * PGSIZE;
+
+              if (pagedir_is_dirty (cur->pagedir, upage) && ofs < length)
+                file_write_at (m->file, kpage,
+                               length - ofs < PGSIZE ? length - ofs : PGSIZE,
+                               ofs);
+              pagedir_clear_page (cur->pagedir, upage);
+              free_user_page (p, kpage);
+            }
+          file_close (m->file);
+
+          list_remove (&m->elem);
+          free (m);
+          break;
+        }
+    }
+  lock_release (&p->mmap_lock);
+}
+
+/** Looks up user address UADDR in the current process, as for
+   pagedir_get_user_page(), and pins its page in PIN until
+   process_unpin_page(), so that its frame stays allocated even if
+   another thread unmaps it or exits meanwhile.  Returns the kernel
+   address of UADDR, or a null pointer if it is not a mapped user
+   address (writable, if WRITE is true). */
+uint8_t *
+process_pin_page (struct page_pin *pin, const void *uaddr, bool write)
+{
+  struct thread *cur = thread_current ();
+  struct process *p = cur->process;
+  uint8_t *kaddr;
+  struct list_elem *e;
+
+  if (!is_user_vaddr (uaddr))
+    return NULL;
+
+  lock_acquire (&p->mmap_lock);
+  kaddr = pagedir_get_user_page (cur->pagedir, uaddr, write);
+  if (kaddr != NULL)
+    {
+      pin->kpage = pg_round_down (kaddr);
+      pin->shm = NULL;
+      pin->free = false;
+      list_push_back (&p->pins, &pin->elem);
+
+      /* Shared memory frames are freed by the region's last
+         close, so hold a reference to the region instead. */
+      for (e = list_begin (&p->mmaps); e != list_end (&p->mmaps);
+           e = list_next (e))
+        {
+          struct mmap *m = list_entry (e, struct mmap, elem);
+
+          if (m->shm != NULL && (uint8_t *) uaddr >= m->addr
+              && (uint8_t *) uaddr < m->addr + m->page_cnt * PGSIZE)
+            {
+              pin->shm = m->shm;
+              shm_dup (pin->shm);
+              break;
+            }
+        }
+    }
+  lock_release (&p->mmap_lock);
+  return kaddr;
+}
+
+/** Releases PIN, set up by process_pin_page(), freeing its frame
+   if the page was unmapped meanwhile and no other pin holds it. */
+void
+process_unpin_page (struct page_pin *pin)
+{
+  struct process *p = thread_current ()->process;
+  bool free_page;
+  struct list_elem *e;
+
+  lock_acquire (&p->mmap_lock);
+  list_remove (&pin->elem);
+  free_page = pin->free;
+  if (free_page)
+    for (e = list_begin (&p->pins); e != list_end (&p->pins);
+         e = list_next (e))
+      if (list_entry (e, struct page_pin, elem)->kpage == pin->kpage)
+        {
+          free_page = false;
+          break;
+        }
+  lock_release (&p->mmap_lock);
+
+  if (free_page)
+    palloc_free_page (pin->kpage);
+  if (pin->shm != NULL)
+    shm_close (pin->shm);
+}
+
+/** Returns the kernel address of the word at user address UADDR
+   in the current process, which must be mapped writable, or a null
+   pointer if it is not.  If VALP is nonnull, also stores the word's
+   value into *VALP.  The lookup and the read hold mmap_lock, so
+   that the word cannot be unmapped in between.
+
+   A page still sharing the zero page gets a frame of its own
+   first, but unlike process_pin_page() this does not mark the page
+   dirty, since the word is only read. */
+const int32_t *
+process_get_word (int32_t *uaddr, int32_t *valp)
+{
+  struct thread *cur = thread_current ();
+  struct process *p = cur->process;
+  const int32_t *kaddr = NULL;
+
+  if (!is_user_vaddr (uaddr))
+    return NULL;
+
+  lock_acquire (&p->mmap_lock);
+  pagedir_unshare_zero_page (cur->pagedir, pg_round_down (uaddr));
+  if (pagedir_is_writable (cur->pagedir, uaddr))
+    {
+      kaddr = pagedir_get_page (cur->pagedir, uaddr);
+      if (valp != NULL)
+        *valp = *kaddr;
+    }
+  lock_release (&p->mmap_lock);
+  return kaddr;
+}
+
+/** Frees user frame KPAGE of process P, which has just been
+   unmapped, or leaves it to the last process_unpin_page() if a
+   system call has it pinned.  P's mmap_lock must be held. */
+static void
+free_user_page (struct process *p, void *kpage)
+{
+  bool pinned = false;
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&p->mmap_lock));
+
+  for (e = list_begin (&p->pins); e != list_end (&p->pins);
+       e = list_next (e))
+    {
+      struct page_pin *pin = list_entry (e, struct page_pin, elem);
+
+      if (pin->kpage == kpage)
+        {
+          pin->free = true;
+          pinned = true;
+        }
     }
+  if (!pinned)
+    palloc_free_page (kpage);
 }
 
 /** Sets up the CPU for running user code in the current
@@ -124,8 +1498,15 @@ process_activate (void)
 {
   struct thread *t = thread_current ();
 
-  /* Activate thread's page tables. */
-  pagedir_activate (t->pagedir);
+  /* Activate thread's page tables.  A kernel thread has no user
+     mappings of its own and every page directory contains the
+     kernel mappings, so it simply borrows whatever page directory
+     is already loaded instead of flushing the TLB ("lazy TLB").
+     The borrowed page directory stays valid because a process
+     switches to the kernel-only page directory before destroying
+     its own; see process_exit(). */
+  if (t->pagedir != NULL)
+    pagedir_activate (t->pagedir);
 
   /* Set thread's kernel stack for use in processing
      interrupts. */
@@ -195,28 +1576,68 @@ struct Elf32_Phdr
 #define PF_W 2          /**< Writable. */
 #define PF_R 4          /**< Readable. */
 
-static bool setup_stack (void **esp);
+/** Executable image cache.
+
+   Each entry holds the validated loadable segments and entry point
+   of one executable, so that starting the same program again skips
+   reading and checking its ELF headers.  Entries are keyed by
+   inode and keep it open.  Writing or removing a cached inode
+   calls process_forget_exec(), which drops its entry at once, so
+   a removed executable's blocks are not held until eviction.
+
+   Protected by exec_cache_lock, which is never held across disk
+   I/O: load() copies out what it needs on a hit, and on a miss
+   reads the headers without the lock and then adds them. */
+struct exec_image
+  {
+    struct inode *inode;        /**< Executable, or NULL if unused. */
+    unsigned write_cnt;         /**< inode_write_cnt() when filled. */
+    unsigned last_use;          /**< exec_clock at last use. */
+    Elf32_Addr entry;           /**< Entry point. */
+    int seg_cnt;                /**< Number of loadable segments. */
+    struct Elf32_Phdr *segs;    /**< Loadable segments. */
+  };
+
+#define EXEC_CACHE_SIZE 8       /**< Number of cached executables. */
+static struct exec_image exec_cache[EXEC_CACHE_SIZE];
+static unsigned exec_clock;     /**< Ticks once per cache use. */
+
+static bool lookup_exec_image (struct inode *, struct exec_image *);
+static bool read_exec_image (struct file *, const char *file_name,
+                             struct exec_image *);
+static void add_exec_image (struct inode *, const struct exec_image *);
+static bool setup_stack (void **esp, char *file_name, char **save_ptr);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
 
-/** Loads an ELF executable from FILE_NAME into the current thread.
+/** Loads the ELF executable named by the first word of CMD_LINE
+   into the current thread, passing it the remaining words as
+   arguments.  CMD_LINE is modified.
    Stores the executable's entry point into *EIP
    and its initial stack pointer into *ESP.
    Returns true if successful, false otherwise. */
-bool
-load (const char *file_name, void (**eip) (void), void **esp) 
+static bool
+load (char *cmd_line, void (**eip) (void), void **esp) 
 {
   struct thread *t = thread_current ();
-  struct Elf32_Ehdr ehdr;
+  struct exec_image image;
+  struct inode *inode;
   struct file *file = NULL;
-  off_t file_ofs;
+  char *file_name, *save_ptr;
   bool success = false;
   int i;
 
+  /* Split off the program name.  The rest of CMD_LINE is split
+     into arguments as they are copied onto the stack. */
+  file_name = strtok_r (cmd_line, " ", &save_ptr);
+  if (file_name == NULL)
+    return false;
+  image.segs = NULL;
+
   /* Allocate and activate page directory. */
-  t->pagedir = pagedir_create ();
+  t->process->pagedir = t->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
     goto done;
   process_activate ();
@@ -229,90 +1650,64 @@ load (const char *file_name, void (**eip) (void), void **esp)
       goto done; 
     }
 
-  /* Read and verify executable header. */
-  if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
-      || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
-      || ehdr.e_type != 2
-      || ehdr.e_machine != 3
-      || ehdr.e_version != 1
-      || ehdr.e_phentsize != sizeof (struct Elf32_Phdr)
-      || ehdr.e_phnum > 1024) 
+  /* Copy the executable's headers from the cache, or read them
+     and add them to it.  The write count is taken first, so that
+     headers changed while we read them are not cached. */
+  inode = file_get_inode (file);
+  if (!lookup_exec_image (inode, &image))
     {
-      printf ("load: %s: error loading executable\n", file_name);
-      goto done; 
+      image.write_cnt = inode_write_cnt (inode);
+      if (!read_exec_image (file, file_name, &image))
+        goto done;
+      add_exec_image (inode, &image);
     }
 
-  /* Read program headers. */
-  file_ofs = ehdr.e_phoff;
-  for (i = 0; i < ehdr.e_phnum; i++) 
+  /* Load the segments. */
+  for (i = 0; i < image.seg_cnt; i++) 
     {
-      struct Elf32_Phdr phdr;
-
-      if (file_ofs < 0 || file_ofs > file_length (file))
-        goto done;
-      file_seek (file, file_ofs);
-
-      if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-        goto done;
-      file_ofs += sizeof phdr;
-      switch (phdr.p_type) 
+      const struct Elf32_Phdr *phdr = &image.segs[i];
+      bool writable = (phdr->p_flags & PF_W) != 0;
+      uint32_t file_page = phdr->p_offset & ~PGMASK;
+      uint32_t mem_page = phdr->p_vaddr & ~PGMASK;
+      uint32_t page_offset = phdr->p_vaddr & PGMASK;
+      uint32_t read_bytes, zero_bytes;
+      if (phdr->p_filesz > 0)
         {
-        case PT_NULL:
-        case PT_NOTE:
-        case PT_PHDR:
-        case PT_STACK:
-        default:
-          /* Ignore this segment. */
-          break;
-        case PT_DYNAMIC:
-        case PT_INTERP:
-        case PT_SHLIB:
-          goto done;
-        case PT_LOAD:
-          if (validate_segment (&phdr, file)) 
-            {
-              bool writable = (phdr.p_flags & PF_W) != 0;
-              uint32_t file_page = phdr.p_offset & ~PGMASK;
-              uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
-              uint32_t page_offset = phdr.p_vaddr & PGMASK;
-              uint32_t read_bytes, zero_bytes;
-              if (phdr.p_filesz > 0)
-                {
-                  /* Normal segment.
-                     Read initial part from disk and zero the rest. */
-                  read_bytes = page_offset + phdr.p_filesz;
-                  zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
-                                - read_bytes);
-                }
-              else 
-                {
-                  /* Entirely zero.
-                     Don't read anything from disk. */
-                  read_bytes = 0;
-                  zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
-                }
-              if (!load_segment (file, file_page, (void *) mem_page,
-                                 read_bytes, zero_bytes, writable))
-                goto done;
-            }
-          else
-            goto done;
-          break;
+          /* Normal segment.
+             Read initial part from disk and zero the rest. */
+          read_bytes = page_offset + phdr->p_filesz;
+          zero_bytes = (ROUND_UP (page_offset + phdr->p_memsz, PGSIZE)
+                        - read_bytes);
+        }
+      else 
+        {
+          /* Entirely zero.
+             Don't read anything from disk. */
+          read_bytes = 0;
+          zero_bytes = ROUND_UP (page_offset + phdr->p_memsz, PGSIZE);
         }
+      if (!load_segment (file, file_page, (void *) mem_page,
+                         read_bytes, zero_bytes, writable))
+        goto done;
     }
 
   /* Set up stack. */
-  if (!setup_stack (esp))
+  if (!setup_stack (esp, file_name, &save_ptr))
     goto done;
 
   /* Start address. */
-  *eip = (void (*) (void)) ehdr.e_entry;
+  *eip = (void (*) (void)) image.entry;
 
+  /* Keep the executable open, and unwritable, while it runs. */
+  file_deny_write (file);
+  t->process->exec_file = file;
   success = true;
 
  done:
   /* We arrive here whether the load is successful or not. */
-  file_close (file);
+  if (!success)
+    file_close (file);
+  free (image.segs);
   return success;
 }
 
@@ -320,6 +1715,194 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
 static bool install_page (void *upage, void *kpage, bool writable);
 
+/** Releases the resources held by cache entry E and marks it
+   unused. */
+static void
+clear_exec_image (struct exec_image *e)
+{
+  inode_close (e->inode);
+  free (e->segs);
+  e->inode = NULL;
+  e->segs = NULL;
+  e->seg_cnt = 0;
+}
+
+/** Reads and verifies the ELF headers of FILE, named FILE_NAME,
+   storing its entry point and loadable segments into E.  Returns
+   true if successful, false otherwise. */
+static bool
+read_exec_image (struct file *file, const char *file_name,
+                 struct exec_image *e)
+{
+  struct Elf32_Ehdr ehdr;
+  struct Elf32_Phdr *phdrs;
+  off_t phdrs_size;
+  int i;
+
+  /* Read and verify executable header. */
+  if (file_read_at (file, &ehdr, sizeof ehdr, 0) != sizeof ehdr
+      || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
+      || ehdr.e_type != 2
+      || ehdr.e_machine != 3
+      || ehdr.e_version != 1
+      || ehdr.e_phentsize != sizeof (struct Elf32_Phdr)
+      || ehdr.e_phnum > 1024) 
+    {
+      printf ("load: %s: error loading executable\n", file_name);
+      return false;
+    }
+
+  /* Read all the program headers at once. */
+  phdrs_size = ehdr.e_phnum * sizeof *phdrs;
+  if (ehdr.e_phoff > (Elf32_Off) file_length (file))
+    return false;
+  phdrs = malloc (phdrs_size);
+  if (phdrs == NULL && phdrs_size > 0)
+    return false;
+  if (file_read_at (file, phdrs, phdrs_size, ehdr.e_phoff) != phdrs_size)
+    goto fail;
+
+  /* Keep only the loadable segments, packed at the front. */
+  e->seg_cnt = 0;
+  for (i = 0; i < ehdr.e_phnum; i++) 
+    switch (phdrs[i].p_type) 
+      {
+      case PT_NULL:
+      case PT_NOTE:
+      case PT_PHDR:
+      case PT_STACK:
+      default:
+        /* Ignore this segment. */
+        break;
+      case PT_DYNAMIC:
+      case PT_INTERP:
+      case PT_SHLIB:
+        goto fail;
+      case PT_LOAD:
+        if (!validate_segment (&phdrs[i], file))
+          goto fail;
+        phdrs[e->seg_cnt++] = phdrs[i];
+        break;
+      }
+
+  e->entry = ehdr.e_entry;
+  e->segs = phdrs;
+  return true;
+
+ fail:
+  free (phdrs);
+  return false;
+}
+
+/** Looks up INODE in the executable image cache.  If it has an
+   up-to-date entry, copies the entry into *IMAGE, with its own
+   copy of the segments, and returns true.  Otherwise, or if memory
+   is short, returns false. */
+static bool
+lookup_exec_image (struct inode *inode, struct exec_image *image)
+{
+  struct exec_image *e;
+  bool found = false;
+
+  lock_acquire (&exec_cache_lock);
+  for (e = exec_cache; e < exec_cache + EXEC_CACHE_SIZE; e++)
+    if (e->inode == inode)
+      {
+        /* A write can race with process_forget_exec(), so check
+           that the entry is still current. */
+        if (e->write_cnt != inode_write_cnt (inode))
+          clear_exec_image (e);
+        else
+          {
+            size_t segs_size = e->seg_cnt * sizeof *e->segs;
+
+            *image = *e;
+            image->segs = malloc (segs_size);
+            if (image->segs != NULL)
+              {
+                memcpy (image->segs, e->segs, segs_size);
+                e->last_use = ++exec_clock;
+                found = true;
+              }
+          }
+        break;
+      }
+  lock_release (&exec_cache_lock);
+  return found;
+}
+
+/** Adds a copy of IMAGE, holding the headers of INODE as of
+   IMAGE's write count, to the executable image cache.  Does
+   nothing if INODE has been written or removed since then, or if
+   memory is short. */
+static void
+add_exec_image (struct inode *inode, const struct exec_image *image)
+{
+  size_t segs_size = image->seg_cnt * sizeof *image->segs;
+  struct Elf32_Phdr *segs;
+  struct inode *old_inode = NULL;
+  struct Elf32_Phdr *old_segs = NULL;
+  struct exec_image *e, *victim = NULL;
+
+  segs = malloc (segs_size);
+  if (segs == NULL)
+    return;
+  memcpy (segs, image->segs, segs_size);
+
+  lock_acquire (&exec_cache_lock);
+  for (e = exec_cache; e < exec_cache + EXEC_CACHE_SIZE; e++)
+    {
+      /* Another load may have added INODE meanwhile. */
+      if (e->inode == inode)
+        {
+          victim = e;
+          break;
+        }
+
+      /* Prefer an unused entry, then the least recently used. */
+      if (victim == NULL
+          || (victim->inode != NULL
+              && (e->inode == NULL || e->last_use < victim->last_use)))
+        victim = e;
+    }
+  if (inode_mark_exec (inode, image->write_cnt))
+    {
+      /* Closing an evicted inode may free its blocks, so do that
+         after releasing the lock. */
+      old_inode = victim->inode;
+      old_segs = victim->segs;
+      *victim = *image;
+      victim->inode = inode_reopen (inode);
+      victim->segs = segs;
+      victim->last_use = ++exec_clock;
+      segs = NULL;
+    }
+  lock_release (&exec_cache_lock);
+
+  inode_close (old_inode);
+  free (old_segs);
+  free (segs);
+}
+
+/** Drops INODE from the executable image cache, if it is there.
+   Called by the file system when a cached executable is written
+   or removed.  The caller has INODE open, so this is never the
+   last close. */
+void
+process_forget_exec (struct inode *inode)
+{
+  struct exec_image *e;
+
+  lock_acquire (&exec_cache_lock);
+  for (e = exec_cache; e < exec_cache + EXEC_CACHE_SIZE; e++)
+    if (e->inode == inode)
+      {
+        clear_exec_image (e);
+        break;
+      }
+  lock_release (&exec_cache_lock);
+}
+
 /** Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
 static bool
@@ -396,6 +1979,20 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+      /* A page with nothing to read is mapped to the shared zero
+         page; a frame is allocated only if it is ever written. */
+      if (page_read_bytes == 0)
+        {
+          struct thread *t = thread_current ();
+
+          if (pagedir_get_page (t->pagedir, upage) != NULL
+              || !pagedir_set_zero_page (t->pagedir, upage, writable))
+            return false;
+          zero_bytes -= page_zero_bytes;
+          upage += PGSIZE;
+          continue;
+        }
+
       /* Get a page of memory. */
       uint8_t *kpage = palloc_get_page (PAL_USER);
       if (kpage == NULL)
@@ -424,24 +2021,77 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   return true;
 }
 
-/** Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
+/** Creates a minimal stack by mapping a zeroed page at the top of
+   user virtual memory, and lays out the program's arguments on it
+   the way the 80x86 calling convention expects to find them on
+   entry to main():
+
+        PHYS_BASE  argument strings, argv[0]'s highest
+                   padding to a word boundary
+                   argv[argc] (a null pointer)
+                   argv[argc - 1] ... argv[0]
+                   argv
+                   argc
+        *ESP  -->  fake return address
+
+   The arguments are FILE_NAME followed by the words strtok_r()
+   has yet to return from SAVE_PTR.  They are laid out in a single
+   pass with no extra memory: each string is copied below the
+   previous one, while its user address is recorded in a scratch
+   array that grows up from the bottom of the same page, and that
+   array is finally moved into place below the strings.
+
+   Returns false if memory allocation fails or if the arguments do
+   not fit in the page. */
 static bool
-setup_stack (void **esp) 
+setup_stack (void **esp, char *file_name, char **save_ptr) 
 {
-  uint8_t *kpage;
-  bool success = false;
+  uint8_t *upage = stack_slot_page (0);
+  uint8_t *kpage, *top;
+  char **uargv, **argv;
+  char *arg;
+  int argc;
 
   kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-  if (kpage != NULL) 
+  if (kpage == NULL)
+    return false;
+  if (!install_page (upage, kpage, true))
     {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success)
-        *esp = PHYS_BASE;
-      else
-        palloc_free_page (kpage);
+      palloc_free_page (kpage);
+      return false;
     }
-  return success;
+
+  /* Copy the strings down from the top of the page, recording
+     their user addresses in UARGV at the bottom.  The page is
+     owned by the page directory from here on, so on failure it is
+     freed along with it. */
+  uargv = (char **) kpage;
+  top = kpage + PGSIZE;
+  argc = 0;
+  for (arg = file_name; arg != NULL; arg = strtok_r (NULL, " ", save_ptr))
+    {
+      size_t size = strlen (arg) + 1;
+
+      if ((size_t) (top - (uint8_t *) (uargv + argc + 1)) < size)
+        return false;
+      top -= size;
+      memcpy (top, arg, size);
+      uargv[argc++] = (char *) upage + (top - kpage);
+    }
+
+  /* Below the word-aligned strings go the null sentinel, the argv
+     array, argv, argc and the return address. */
+  argv = (char **) ROUND_DOWN ((uintptr_t) top, sizeof (char *)) - 1 - argc;
+  if ((uint8_t *) (argv - 3) < kpage)
+    return false;
+  memmove (argv, uargv, argc * sizeof *argv);
+  argv[argc] = NULL;
+  argv[-1] = (char *) upage + ((uint8_t *) argv - kpage);
+  argv[-2] = (char *) argc;
+  argv[-3] = NULL;
+
+  *esp = upage + ((uint8_t *) (argv - 3) - kpage);
+  return true;
 }
 
 /** Adds a mapping from user virtual address UPAGE to kernel
@@ -3,9 +3,98 @@
 
 #include "threads/thread.h"
 
+struct dir;
+struct file;
+struct inode;
+struct pipe;
+struct shm;
+
+/** Most threads a user process may have at once, counting its
+   initial thread. */
+#define UTHREAD_MAX 32
+
+/** Limits on the size of a process's file descriptor table, which
+   starts out with FD_MIN slots and doubles as needed. */
+#define FD_MIN 16               /**< Initial number of descriptors. */
+#define FD_MAX 1024             /**< Maximum number of descriptors. */
+
+/** What an open file descriptor refers to: a file, a directory,
+   one end of a pipe, or a shared memory region.  An open
+   descriptor that refers to none of these is the console. */
+struct fd_entry
+  {
+    struct file *file;          /**< File, or null. */
+    struct pipe *pipe;          /**< Pipe, or null. */
+    bool pipe_writer;           /**< For a pipe, is this the write end? */
+    struct shm *shm;            /**< Shared memory region, or null. */
+    struct dir *dir;            /**< Directory, or null. */
+  };
+
+/** Returns true if E refers to a file, a directory, a pipe or
+   shared memory, false if it refers to the console or is
+   closed. */
+static inline bool
+fd_entry_is_open (const struct fd_entry *e)
+{
+  return (e->file != NULL || e->dir != NULL || e->pipe != NULL
+          || e->shm != NULL);
+}
+
+/** A descriptor to set up in a new process before it runs; see
+   process_spawn().  An ENTRY for which fd_entry_is_open() is false
+   closes FD. */
+struct spawn_fd
+  {
+    int fd;                     /**< Descriptor in the new process. */
+    struct fd_entry entry;      /**< What it is to refer to. */
+  };
+
+/** A user page that a system call is copying to or from, after
+   looking it up with process_pin_page().  While it is pinned,
+   unmapping the page does not free its frame. */
+struct page_pin
+  {
+    struct list_elem elem;      /**< In the process's list of pins. */
+    uint8_t *kpage;             /**< Frame holding the page. */
+    struct shm *shm;            /**< Shared memory it is in, or null. */
+    bool free;                  /**< Unmapped, to be freed on unpin? */
+  };
+
+extern bool process_print_rusage;
+
+void process_init (void);
 tid_t process_execute (const char *file_name);
+tid_t process_spawn (const char *file_name,
+                     const struct spawn_fd *, size_t fd_cnt);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
+void process_exit_all (int status) NO_RETURN;
+void process_kill (void) NO_RETURN;
+void process_check_exit (void);
+
+tid_t process_thread_create (void *eip, void *func, void *aux);
+int process_thread_join (tid_t);
+void process_thread_exit (int status) NO_RETURN;
+
+int process_add_fd (const struct fd_entry *);
+const struct fd_entry *process_get_fd (int fd);
+void process_put_fd (const struct fd_entry *);
+bool process_is_console (int fd);
+bool process_dup_fd (int fd, struct fd_entry *);
+void process_release_fd (const struct fd_entry *);
+bool process_close_fd (int fd);
+
+struct dir *process_open_cwd (void);
+void process_chdir (struct dir *);
+void process_forget_exec (struct inode *);
+
+int process_mmap (struct file *, void *addr);
+int process_shm_attach (struct shm *, void *addr);
+void process_munmap (int mapid);
+uint8_t *process_pin_page (struct page_pin *, const void *uaddr,
+                           bool write);
+void process_unpin_page (struct page_pin *);
+const int32_t *process_get_word (int32_t *uaddr, int32_t *valp);
 
 #endif /**< userprog/process.h */
@@ -0,0 +1,95 @@
+#include "userprog/shm.h"
+#include <debug.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+
+/** A shared memory region: a fixed set of zeroed user frames that
+   any number of processes map into their page directories.  Each
+   descriptor and each mapping for the region holds a reference,
+   and the frames are freed with the last one. */
+struct shm
+  {
+    struct lock lock;           /**< Protects `ref_cnt'. */
+    int ref_cnt;                /**< Number of references. */
+    size_t page_cnt;            /**< Number of frames. */
+    void *pages[1];             /**< Kernel addresses of frames. */
+  };
+
+/** Creates a shared memory region of PAGE_CNT zeroed pages and
+   returns it with one reference, or a null pointer if PAGE_CNT is
+   0 or more than SHM_MAX_PAGES, or if memory is short. */
+struct shm *
+shm_create (size_t page_cnt)
+{
+  struct shm *shm;
+  size_t i;
+
+  if (page_cnt == 0 || page_cnt > SHM_MAX_PAGES)
+    return NULL;
+
+  shm = malloc (sizeof *shm + (page_cnt - 1) * sizeof *shm->pages);
+  if (shm == NULL)
+    return NULL;
+  lock_init (&shm->lock);
+  shm->ref_cnt = 1;
+  shm->page_cnt = page_cnt;
+  for (i = 0; i < page_cnt; i++)
+    {
+      shm->pages[i] = palloc_get_page (PAL_USER | PAL_ZERO);
+      if (shm->pages[i] == NULL)
+        {
+          shm->page_cnt = i;
+          shm_close (shm);
+          return NULL;
+        }
+    }
+  return shm;
+}
+
+/** Adds a reference to SHM. */
+void
+shm_dup (struct shm *shm)
+{
+  lock_acquire (&shm->lock);
+  ASSERT (shm->ref_cnt > 0);
+  shm->ref_cnt++;
+  lock_release (&shm->lock);
+}
+
+/** Drops a reference to SHM, freeing it and its frames if it was
+   the last.  The frames must no longer be mapped anywhere by
+   then. */
+void
+shm_close (struct shm *shm)
+{
+  int ref_cnt;
+  size_t i;
+
+  lock_acquire (&shm->lock);
+  ASSERT (shm->ref_cnt > 0);
+  ref_cnt = --shm->ref_cnt;
+  lock_release (&shm->lock);
+
+  if (ref_cnt == 0)
+    {
+      for (i = 0; i < shm->page_cnt; i++)
+        palloc_free_page (shm->pages[i]);
+      free (shm);
+    }
+}
+
+/** Returns the number of pages in SHM. */
+size_t
+shm_page_cnt (const struct shm *shm)
+{
+  return shm->page_cnt;
+}
+
+/** Returns the kernel address of page IDX of SHM. */
+void *
+shm_get_page (const struct shm *shm, size_t idx)
+{
+  ASSERT (idx < shm->page_cnt);
+  return shm->pages[idx];
+}
@@ -0,0 +1,17 @@
+#ifndef USERPROG_SHM_H
+#define USERPROG_SHM_H
+
+#include <stddef.h>
+
+struct shm;
+
+/** Maximum size of a shared memory region, in pages. */
+#define SHM_MAX_PAGES 1024
+
+struct shm *shm_create (size_t page_cnt);
+void shm_dup (struct shm *);
+void shm_close (struct shm *);
+size_t shm_page_cnt (const struct shm *);
+void *shm_get_page (const struct shm *, size_t idx);
+
+#endif /**< userprog/shm.h */
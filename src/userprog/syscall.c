@@ -1,20 +1,826 @@
 #include "userprog/syscall.h"
+#include <round.h>
+#include <rusage.h>
+#include <spawn.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include <uio.h>
+#include "userprog/futex.h"
+#include "userprog/pagedir.h"
+#include "userprog/pipe.h"
+#include "userprog/shm.h"
+#include "userprog/process.h"
+#include "devices/input.h"
+#include "devices/shutdown.h"
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/** A system call implementation.  ARGS holds the call's
+   arguments, already copied in from the user stack; the return
+   value is passed back to the user in %eax. */
+typedef int syscall_func (const uint32_t *args);
+
+/** A system call table entry. */
+struct syscall
+  {
+    int argc;                   /**< Number of 32-bit arguments. */
+    syscall_func *func;         /**< Implementation. */
+  };
+
+/** Largest number of arguments taken by any system call. */
+#define SYSCALL_MAX_ARGS 3
+
+static syscall_func sys_halt, sys_exit, sys_exec, sys_wait;
+static syscall_func sys_create, sys_remove, sys_open, sys_filesize;
+static syscall_func sys_read, sys_write, sys_seek, sys_tell, sys_close;
+static syscall_func sys_mmap, sys_munmap;
+static syscall_func sys_chdir, sys_mkdir, sys_readdir, sys_isdir;
+static syscall_func sys_inumber, sys_readv, sys_writev, sys_spawn;
+static syscall_func sys_pipe, sys_shm_create, sys_shm_attach;
+static syscall_func sys_futex_wait, sys_futex_wake;
+static syscall_func sys_uthread_create, sys_uthread_join, sys_uthread_exit;
+static syscall_func sys_getrusage;
+
+/** System calls, indexed by number (see lib/syscall-nr.h). */
+static const struct syscall syscall_table[] =
+  {
+    [SYS_HALT] = {0, sys_halt},
+    [SYS_EXIT] = {1, sys_exit},
+    [SYS_EXEC] = {1, sys_exec},
+    [SYS_WAIT] = {1, sys_wait},
+    [SYS_CREATE] = {2, sys_create},
+    [SYS_REMOVE] = {1, sys_remove},
+    [SYS_OPEN] = {1, sys_open},
+    [SYS_FILESIZE] = {1, sys_filesize},
+    [SYS_READ] = {3, sys_read},
+    [SYS_WRITE] = {3, sys_write},
+    [SYS_SEEK] = {2, sys_seek},
+    [SYS_TELL] = {1, sys_tell},
+    [SYS_CLOSE] = {1, sys_close},
+    [SYS_MMAP] = {2, sys_mmap},
+    [SYS_MUNMAP] = {1, sys_munmap},
+    [SYS_CHDIR] = {1, sys_chdir},
+    [SYS_MKDIR] = {1, sys_mkdir},
+    [SYS_READDIR] = {2, sys_readdir},
+    [SYS_ISDIR] = {1, sys_isdir},
+    [SYS_INUMBER] = {1, sys_inumber},
+    [SYS_READV] = {3, sys_readv},
+    [SYS_WRITEV] = {3, sys_writev},
+    [SYS_SPAWN] = {3, sys_spawn},
+    [SYS_PIPE] = {1, sys_pipe},
+    [SYS_SHM_CREATE] = {1, sys_shm_create},
+    [SYS_SHM_ATTACH] = {2, sys_shm_attach},
+    [SYS_FUTEX_WAIT] = {2, sys_futex_wait},
+    [SYS_FUTEX_WAKE] = {2, sys_futex_wake},
+    [SYS_UTHREAD_CREATE] = {3, sys_uthread_create},
+    [SYS_UTHREAD_JOIN] = {1, sys_uthread_join},
+    [SYS_UTHREAD_EXIT] = {1, sys_uthread_exit},
+    [SYS_GETRUSAGE] = {1, sys_getrusage},
+  };
 
 static void syscall_handler (struct intr_frame *);
 
 void
-syscall_init (void) 
+syscall_init (void)
 {
+  process_init ();
+  futex_init ();
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
+/** Dispatches a system call.  The user pushed the call number
+   followed by its arguments, so they lie in consecutive words
+   starting at the user's stack pointer. */
 static void
-syscall_handler (struct intr_frame *f UNUSED) 
+syscall_handler (struct intr_frame *f)
+{
+  const uint32_t *usp = f->esp;
+  uint32_t args[SYSCALL_MAX_ARGS];
+  const struct syscall *sc;
+  uint32_t number;
+
+  copy_in (&number, usp, sizeof number);
+  if (number >= sizeof syscall_table / sizeof *syscall_table
+      || syscall_table[number].func == NULL)
+    process_kill ();
+
+  if (number < RUSAGE_SYSCALLS)
+    thread_current ()->rusage->syscalls[number]++;
+
+  sc = &syscall_table[number];
+  ASSERT (sc->argc <= SYSCALL_MAX_ARGS);
+  copy_in (args, usp + 1, sizeof *args * sc->argc);
+  f->eax = sc->func (args);
+}
+
+/** User memory access.
+
+   User pointers are not checked up front.  Instead, the kernel
+   just dereferences them, after making sure they are below
+   PHYS_BASE, through the two accessors below.  If the access
+   faults, page_fault() sees a kernel-mode fault on a user
+   address and resumes at the address the accessor left in %eax,
+   with %eax set to -1.  Valid accesses thus cost no more than an
+   ordinary load or store, with no page table walk. */
+
+/** Reads a byte at user virtual address UADDR, which must be
+   below PHYS_BASE.  Returns the byte value if successful, -1 if a
+   segfault occurred. */
+static inline int
+get_user (const uint8_t *uaddr)
+{
+  int result;
+  asm ("movl $1f, %0; movzbl %1, %0; 1:"
+       : "=&a" (result) : "m" (*uaddr));
+  return result;
+}
+
+/** Writes BYTE to user address UDST, which must be below
+   PHYS_BASE.  Returns true if successful, false if a segfault
+   occurred. */
+static inline bool
+put_user (uint8_t *udst, uint8_t byte)
+{
+  int error_code;
+  asm ("movl $1f, %0; movb %b2, %1; 1:"
+       : "=&a" (error_code), "=m" (*udst) : "q" (byte));
+  return error_code != -1;
+}
+
+/** Copies SIZE bytes from user address USRC to kernel address
+   DST.  Kills the process if any byte of USRC is invalid. */
+void
+copy_in (void *dst_, const void *usrc_, size_t size)
+{
+  uint8_t *dst = dst_;
+  const uint8_t *usrc = usrc_;
+
+  for (; size > 0; size--, dst++, usrc++)
+    {
+      int byte;
+
+      if (!is_user_vaddr (usrc) || (byte = get_user (usrc)) == -1)
+        process_kill ();
+      *dst = byte;
+    }
+}
+
+/** Copies SIZE bytes from kernel address SRC to user address
+   UDST.  Kills the process if any byte of UDST is invalid. */
+void
+copy_out (void *udst_, const void *src_, size_t size)
+{
+  uint8_t *udst = udst_;
+  const uint8_t *src = src_;
+
+  for (; size > 0; size--, udst++, src++)
+    if (!is_user_vaddr (udst) || !put_user (udst, *src))
+      process_kill ();
+}
+
+/** Creates a copy of user string US in kernel memory and returns
+   it as a page that must be freed with palloc_free_page().
+   Returns a null pointer if US is invalid or longer than a page
+   (including its null terminator), or if no page is available. */
+static char *
+try_copy_in_string (const char *us)
+{
+  char *ks;
+  size_t length;
+
+  ks = palloc_get_page (0);
+  if (ks == NULL)
+    return NULL;
+
+  for (length = 0; length < PGSIZE; length++)
+    {
+      int byte;
+
+      if (!is_user_vaddr (us + length)
+          || (byte = get_user ((const uint8_t *) us + length)) == -1)
+        break;
+      ks[length] = byte;
+      if (byte == '\0')
+        return ks;
+    }
+
+  palloc_free_page (ks);
+  return NULL;
+}
+
+/** Like try_copy_in_string(), but kills the process on
+   failure. */
+char *
+copy_in_string (const char *us)
+{
+  char *ks = try_copy_in_string (us);
+  if (ks == NULL)
+    process_kill ();
+  return ks;
+}
+
+/** Returns what FD refers to in the current process, to be
+   released with process_put_fd(), killing the process if FD is
+   not open to a file. */
+static const struct fd_entry *
+lookup_file (int fd)
+{
+  const struct fd_entry *e = process_get_fd (fd);
+
+  if (e == NULL || e->file == NULL)
+    {
+      if (e != NULL)
+        process_put_fd (e);
+      process_kill ();
+    }
+  return e;
+}
+
+/** Halt system call. */
+static int
+sys_halt (const uint32_t *args UNUSED)
+{
+  shutdown_power_off ();
+}
+
+/** Exit system call. */
+static int
+sys_exit (const uint32_t *args)
 {
-  printf ("system call!\n");
-  thread_exit ();
+  process_exit_all (args[0]);
+}
+
+/** Exec system call. */
+static int
+sys_exec (const uint32_t *args)
+{
+  char *cmd_line = copy_in_string ((const char *) args[0]);
+  tid_t tid = process_execute (cmd_line);
+
+  palloc_free_page (cmd_line);
+  return tid;
+}
+
+/** Wait system call. */
+static int
+sys_wait (const uint32_t *args)
+{
+  return process_wait (args[0]);
+}
+
+/** Create system call. */
+static int
+sys_create (const uint32_t *args)
+{
+  char *name = copy_in_string ((const char *) args[0]);
+  bool ok = filesys_create (name, args[1]);
+
+  palloc_free_page (name);
+  return ok;
+}
+
+/** Remove system call. */
+static int
+sys_remove (const uint32_t *args)
+{
+  char *name = copy_in_string ((const char *) args[0]);
+  bool ok = filesys_remove (name);
+
+  palloc_free_page (name);
+  return ok;
+}
+
+/** Open system call.  Opens a file or a directory. */
+static int
+sys_open (const uint32_t *args)
+{
+  char *name = copy_in_string ((const char *) args[0]);
+  struct inode *inode;
+  int fd = -1;
+
+  inode = filesys_open_inode (name);
+  if (inode != NULL)
+    {
+      struct fd_entry e;
+
+      if (inode_is_dir (inode))
+        e = (struct fd_entry) {.dir = dir_open (inode)};
+      else
+        e = (struct fd_entry) {.file = file_open (inode)};
+      if (fd_entry_is_open (&e))
+        {
+          fd = process_add_fd (&e);
+          if (fd < 0)
+            {
+              file_close (e.file);
+              dir_close (e.dir);
+            }
+        }
+    }
+
+  palloc_free_page (name);
+  return fd;
+}
+
+/** Filesize system call. */
+static int
+sys_filesize (const uint32_t *args)
+{
+  const struct fd_entry *e = lookup_file (args[0]);
+  int size = file_length (e->file);
+
+  process_put_fd (e);
+  return size;
+}
+
+/** Transfers up to SIZE bytes between user buffer UBUF and file
+   descriptor FD: from FD into UBUF if READ is true, from UBUF to
+   FD otherwise.
+
+   Each user page is resolved once through the page directory and
+   data moves directly between that page's kernel mapping and the
+   file, with no intermediate kernel buffer: the file system copies
+   straight between the page and its buffer cache.  The page stays
+   pinned while the transfer blocks, so that another thread that
+   unmaps it cannot free the frame under us.
+
+   Returns the number of bytes transferred, which is less than
+   SIZE only at end of file, if the file system cannot go on, if a
+   pipe has less data to read, or if a pipe's read end is closed.
+   Kills the process if FD is not open in the right direction or
+   if UBUF is not a valid user buffer (writable, if READ is
+   true). */
+static int
+xfer (int fd, uint8_t *ubuf, size_t size, bool read)
+{
+  const struct fd_entry *e = NULL;
+  bool bad_ptr = false;
+  size_t done = 0;
+
+  /* Hold on to the descriptor, so that it stays open even if
+     another thread closes it while a pipe transfer blocks.  A null
+     E stands for the console. */
+  if (fd != (read ? STDIN_FILENO : STDOUT_FILENO)
+      || !process_is_console (fd))
+    {
+      e = process_get_fd (fd);
+      if (e == NULL
+          || (e->file == NULL
+              && (e->pipe == NULL || e->pipe_writer == read)))
+        {
+          if (e != NULL)
+            process_put_fd (e);
+          process_kill ();
+        }
+    }
+
+  while (done < size)
+    {
+      uint8_t *uaddr = ubuf + done;
+      size_t page_left = PGSIZE - pg_ofs (uaddr);
+      size_t chunk = size - done < page_left ? size - done : page_left;
+      struct page_pin pin;
+      uint8_t *kaddr;
+      off_t retval;
+
+      kaddr = process_pin_page (&pin, uaddr, read);
+      if (kaddr == NULL)
+        {
+          bad_ptr = true;
+          break;
+        }
+
+      if (e == NULL)
+        {
+          /* Console. */
+          if (read)
+            {
+              size_t i;
+              for (i = 0; i < chunk; i++)
+                if (!input_getc_interruptible (kaddr + i))
+                  break;
+              retval = i;
+            }
+          else
+            {
+              putbuf ((const char *) kaddr, chunk);
+              retval = chunk;
+            }
+        }
+      else if (e->pipe != NULL)
+        retval = (read
+                  ? pipe_read (e->pipe, kaddr, chunk)
+                  : pipe_write (e->pipe, kaddr, chunk));
+      else
+        retval = (read
+                  ? file_read (e->file, kaddr, chunk)
+                  : file_write (e->file, kaddr, chunk));
+      process_unpin_page (&pin);
+      if (retval <= 0)
+        break;
+
+      done += retval;
+      if ((size_t) retval != chunk)
+        break;
+    }
+
+  if (e != NULL)
+    process_put_fd (e);
+  if (bad_ptr)
+    process_kill ();
+  return done;
+}
+
+/** Read system call. */
+static int
+sys_read (const uint32_t *args)
+{
+  return xfer (args[0], (uint8_t *) args[1], args[2], true);
+}
+
+/** Write system call. */
+static int
+sys_write (const uint32_t *args)
+{
+  return xfer (args[0], (uint8_t *) args[1], args[2], false);
+}
+
+/** Performs a vectored transfer of IOVCNT buffers described by
+   user array UIOV to or from FD, as for xfer(), all in one system
+   call.  Stops at the first buffer that is not transferred in
+   full.  Returns the total number of bytes transferred, or -1 if
+   IOVCNT is out of range. */
+static int
+vxfer (int fd, const struct iovec *uiov, int iovcnt, bool read)
+{
+  int total = 0;
+  int i;
+
+  if (iovcnt < 0 || iovcnt > IOV_MAX)
+    return -1;
+
+  for (i = 0; i < iovcnt; i++)
+    {
+      struct iovec iov;
+      int retval;
+
+      copy_in (&iov, uiov + i, sizeof iov);
+      retval = xfer (fd, iov.iov_base, iov.iov_len, read);
+      total += retval;
+      if ((size_t) retval != iov.iov_len)
+        break;
+    }
+
+  return total;
+}
+
+/** Readv system call. */
+static int
+sys_readv (const uint32_t *args)
+{
+  return vxfer (args[0], (const struct iovec *) args[1], args[2], true);
+}
+
+/** Writev system call. */
+static int
+sys_writev (const uint32_t *args)
+{
+  return vxfer (args[0], (const struct iovec *) args[1], args[2], false);
+}
+
+/** Turns the CNT user ACTIONS for a spawn() into descriptors for
+   process_spawn(), opening files and duplicating descriptors as
+   needed, and stores them in FDS.  Returns true if successful.
+   Returns false if an action is invalid, a file cannot be opened
+   or a path is a bad pointer, in which case *BAD_PTR tells which
+   and nothing is left open.
+
+   A duplicated file has its own file position, which starts out at
+   the original's.  The console cannot be duplicated. */
+static bool
+prepare_spawn_fds (const struct spawn_action *actions, int cnt,
+                   struct spawn_fd *fds, bool *bad_ptr)
+{
+  int i;
+
+  *bad_ptr = false;
+  for (i = 0; i < cnt; i++)
+    {
+      const struct spawn_action *a = &actions[i];
+      struct fd_entry *e = &fds[i].entry;
+
+      if (a->fd < 0 || a->fd >= FD_MAX)
+        goto fail;
+      fds[i].fd = a->fd;
+      memset (e, 0, sizeof *e);
+      if (a->type == SPAWN_DUP)
+        {
+          if (!process_dup_fd (a->src_fd, e))
+            goto fail;
+        }
+      else if (a->type == SPAWN_OPEN)
+        {
+          char *path = try_copy_in_string (a->path);
+          if (path == NULL)
+            {
+              *bad_ptr = true;
+              goto fail;
+            }
+          e->file = filesys_open (path);
+          palloc_free_page (path);
+          if (e->file == NULL)
+            goto fail;
+        }
+      else if (a->type != SPAWN_CLOSE)
+        goto fail;
+    }
+  return true;
+
+ fail:
+  while (i-- > 0)
+    process_release_fd (&fds[i].entry);
+  return false;
+}
+
+/** Spawn system call. */
+static int
+sys_spawn (const uint32_t *args)
+{
+  struct spawn_action actions[SPAWN_MAX_ACTIONS];
+  struct spawn_fd fds[SPAWN_MAX_ACTIONS];
+  int action_cnt = args[2];
+  char *cmd_line;
+  bool bad_ptr;
+  tid_t tid;
+
+  if (action_cnt < 0 || action_cnt > SPAWN_MAX_ACTIONS)
+    return TID_ERROR;
+  copy_in (actions, (const void *) args[1], action_cnt * sizeof *actions);
+
+  cmd_line = copy_in_string ((const char *) args[0]);
+  if (!prepare_spawn_fds (actions, action_cnt, fds, &bad_ptr))
+    {
+      palloc_free_page (cmd_line);
+      if (bad_ptr)
+        process_kill ();
+      return TID_ERROR;
+    }
+  tid = process_spawn (cmd_line, fds, action_cnt);
+
+  palloc_free_page (cmd_line);
+  return tid;
+}
+
+/** Pipe system call. */
+static int
+sys_pipe (const uint32_t *args)
+{
+  struct fd_entry reader, writer;
+  struct pipe *p;
+  int fds[2];
+
+  p = pipe_create ();
+  if (p == NULL)
+    return false;
+
+  reader = (struct fd_entry) {.pipe = p, .pipe_writer = false};
+  writer = (struct fd_entry) {.pipe = p, .pipe_writer = true};
+  fds[0] = process_add_fd (&reader);
+  if (fds[0] < 0)
+    {
+      pipe_close (p, false);
+      pipe_close (p, true);
+      return false;
+    }
+  fds[1] = process_add_fd (&writer);
+  if (fds[1] < 0)
+    {
+      process_close_fd (fds[0]);
+      pipe_close (p, true);
+      return false;
+    }
+
+  copy_out ((int *) args[0], fds, sizeof fds);
+  return true;
+}
+
+/** Seek system call. */
+static int
+sys_seek (const uint32_t *args)
+{
+  const struct fd_entry *e = lookup_file (args[0]);
+
+  if ((off_t) args[1] >= 0)
+    file_seek (e->file, args[1]);
+
+  process_put_fd (e);
+  return 0;
+}
+
+/** Tell system call. */
+static int
+sys_tell (const uint32_t *args)
+{
+  const struct fd_entry *e = lookup_file (args[0]);
+  int position = file_tell (e->file);
+
+  process_put_fd (e);
+  return position;
+}
+
+/** Close system call. */
+static int
+sys_close (const uint32_t *args)
+{
+  if (!process_close_fd (args[0]))
+    process_kill ();
+  return 0;
+}
+
+/** Shm_create system call. */
+static int
+sys_shm_create (const uint32_t *args)
+{
+  struct fd_entry e = {.shm = shm_create (DIV_ROUND_UP (args[0], PGSIZE))};
+  int fd;
+
+  if (e.shm == NULL)
+    return -1;
+  fd = process_add_fd (&e);
+  if (fd < 0)
+    shm_close (e.shm);
+  return fd;
+}
+
+/** Shm_attach system call. */
+static int
+sys_shm_attach (const uint32_t *args)
+{
+  const struct fd_entry *e = process_get_fd (args[0]);
+  int mapid = -1;
+
+  if (e != NULL)
+    {
+      if (e->shm != NULL)
+        mapid = process_shm_attach (e->shm, (void *) args[1]);
+      process_put_fd (e);
+    }
+  return mapid;
+}
+
+/** Futex_wait system call. */
+static int
+sys_futex_wait (const uint32_t *args)
+{
+  return futex_wait ((int32_t *) args[0], args[1]);
+}
+
+/** Futex_wake system call. */
+static int
+sys_futex_wake (const uint32_t *args)
+{
+  return futex_wake ((int32_t *) args[0], args[1]);
+}
+
+/** Uthread_create system call. */
+static int
+sys_uthread_create (const uint32_t *args)
+{
+  return process_thread_create ((void *) args[0], (void *) args[1],
+                                (void *) args[2]);
+}
+
+/** Uthread_join system call. */
+static int
+sys_uthread_join (const uint32_t *args)
+{
+  return process_thread_join (args[0]);
+}
+
+/** Uthread_exit system call. */
+static int
+sys_uthread_exit (const uint32_t *args)
+{
+  process_thread_exit (args[0]);
+}
+
+/** Getrusage system call. */
+static int
+sys_getrusage (const uint32_t *args)
+{
+  struct rusage usage = *thread_current ()->rusage;
+
+  copy_out ((struct rusage *) args[0], &usage, sizeof usage);
+  return 0;
+}
+
+/** Mmap system call. */
+static int
+sys_mmap (const uint32_t *args)
+{
+  const struct fd_entry *e = process_get_fd (args[0]);
+  int mapid = -1;
+
+  if (e != NULL)
+    {
+      if (e->file != NULL)
+        mapid = process_mmap (e->file, (void *) args[1]);
+      process_put_fd (e);
+    }
+  return mapid;
+}
+
+/** Munmap system call. */
+static int
+sys_munmap (const uint32_t *args)
+{
+  process_munmap (args[0]);
+  return 0;
+}
+
+/** Chdir system call. */
+static int
+sys_chdir (const uint32_t *args)
+{
+  char *name = copy_in_string ((const char *) args[0]);
+  struct dir *dir;
+
+  dir = filesys_open_dir (name);
+  if (dir != NULL)
+    process_chdir (dir);
+
+  palloc_free_page (name);
+  return dir != NULL;
+}
+
+/** Mkdir system call. */
+static int
+sys_mkdir (const uint32_t *args)
+{
+  char *name = copy_in_string ((const char *) args[0]);
+  bool ok = filesys_mkdir (name);
+
+  palloc_free_page (name);
+  return ok;
+}
+
+/** Readdir system call.  Kills the process if FD is not open. */
+static int
+sys_readdir (const uint32_t *args)
+{
+  const struct fd_entry *e = process_get_fd (args[0]);
+  char name[NAME_MAX + 1];
+  bool ok = false;
+
+  if (e == NULL)
+    process_kill ();
+  if (e->dir != NULL)
+    ok = dir_readdir (e->dir, name);
+  process_put_fd (e);
+
+  if (ok)
+    copy_out ((char *) args[1], name, strlen (name) + 1);
+  return ok;
+}
+
+/** Isdir system call.  Kills the process if FD is not open. */
+static int
+sys_isdir (const uint32_t *args)
+{
+  const struct fd_entry *e = process_get_fd (args[0]);
+  bool is_dir;
+
+  if (e == NULL)
+    process_kill ();
+  is_dir = e->dir != NULL;
+  process_put_fd (e);
+  return is_dir;
+}
+
+/** Inumber system call.  Kills the process if FD is not open to
+   a file or a directory. */
+static int
+sys_inumber (const uint32_t *args)
+{
+  const struct fd_entry *e = process_get_fd (args[0]);
+  int inumber;
+
+  if (e == NULL || (e->file == NULL && e->dir == NULL))
+    {
+      if (e != NULL)
+        process_put_fd (e);
+      process_kill ();
+    }
+  inumber = inode_get_inumber (e->file != NULL
+                               ? file_get_inode (e->file)
+                               : dir_get_inode (e->dir));
+  process_put_fd (e);
+  return inumber;
 }
@@ -1,6 +1,12 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <stddef.h>
+
 void syscall_init (void);
 
+void copy_in (void *dst, const void *usrc, size_t size);
+void copy_out (void *udst, const void *src, size_t size);
+char *copy_in_string (const char *us);
+
 #endif /**< userprog/syscall.h */